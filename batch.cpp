@@ -0,0 +1,150 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "batch.hpp"
+
+#include "io.hpp"
+#include "prefetch.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+
+size_t hardware_jobs()
+{
+    const auto count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void batch_t::run(const std::function<void(size_t, std::istream&)>& process) const
+{
+    auto prefetcher = prefetcher_t{files, std::max(read_ahead, jobs)};
+    auto error = std::exception_ptr{};
+    auto error_mutex = std::mutex{};
+    auto worker = [&] {
+        auto file = prefetched_t{};
+        while (true) {
+            try {
+                if (!prefetcher.next(file))
+                    break;
+            } catch (...) {
+                auto lock = std::lock_guard{error_mutex};
+                if (!error)
+                    error = std::current_exception();
+                prefetcher.stop();
+                break;
+            }
+            const auto i = file.index;
+            try {
+                if (file.error != 0)
+                    throw std::runtime_error{std::strerror(file.error)};
+                if (!file.complete || detect_compression(file.data.data(), file.data.size()) != compression_t::none) {
+                    // Large and compressed files are streamed.
+                    auto stream = open_input(files[i]);
+                    if (!stream)
+                        throw std::runtime_error{std::strerror(errno)};
+                    process(i, *stream);
+                } else {
+                    auto stream = memory_stream_t{file.data.data(), file.data.data() + file.data.size()};
+                    process(i, stream);
+                }
+            } catch (std::exception& e) {
+                auto lock = std::lock_guard{error_mutex};
+                if (!error)
+                    error = std::make_exception_ptr(std::runtime_error{files[i] + ": " + e.what()});
+                prefetcher.stop();  // stop the other workers
+            }
+        }
+    };
+    const auto count = std::max<size_t>(1, std::min(jobs, files.size()));
+    auto workers = std::vector<std::thread>{};
+    for (size_t i = 1; i < count; ++i)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::vector<std::string> read_manifest(const std::string& path)
+{
+    auto is = std::ifstream{path};
+    if (!is)
+        throw std::runtime_error{path + ": " + std::strerror(errno)};
+    const auto dir = std::filesystem::path{path}.parent_path();
+    auto res = std::vector<std::string>{};
+    auto line = std::string{};
+    while (std::getline(is, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        const auto file = std::filesystem::path{line};
+        res.push_back(file.is_absolute() ? line : (dir / file).string());
+    }
+    if (is.bad())
+        throw std::runtime_error{path + ": " + std::strerror(errno)};
+    return res;
+}
+
+std::vector<std::string> select_shard(const std::vector<std::string>& files, size_t index, size_t count)
+{
+    if (count == 0 || index >= count)
+        throw std::invalid_argument{"shard " + std::to_string(index + 1) + " of " + std::to_string(count)};
+    auto sizes = std::vector<uintmax_t>(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto error = std::error_code{};
+        sizes[i] = std::filesystem::file_size(files[i], error);
+        if (error)
+            throw std::runtime_error{files[i] + ": " + error.message()};
+    }
+    auto order = std::vector<size_t>(files.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sizes[a] != sizes[b] ? sizes[a] > sizes[b] : files[a] != files[b] ? files[a] < files[b] : a < b;
+    });
+    // Shards by increasing total size and number (longest processing time first scheduling)
+    using load_t = std::pair<uintmax_t, size_t>;
+    auto shards = std::priority_queue<load_t, std::vector<load_t>, std::greater<>>{};
+    for (size_t s = 0; s < count; ++s)
+        shards.emplace(0, s);
+    auto selected = std::vector<size_t>{};
+    for (auto i : order) {
+        auto [total, shard] = shards.top();
+        shards.pop();
+        if (shard == index)
+            selected.push_back(i);
+        shards.emplace(total + sizes[i], shard);
+    }
+    std::sort(selected.begin(), selected.end());
+    auto res = std::vector<std::string>{};
+    for (auto i : selected)
+        res.push_back(files[i]);
+    return res;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACER_BATCH_HPP
+#define TRACER_BATCH_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+/** Processes many trace files on a pool of worker threads. */
+struct batch_t
+{
+    std::vector<std::string> files;  ///< trace files to process
+    size_t jobs{1};                  ///< number of worker threads
+    size_t read_ahead{64};           ///< number of files read into memory ahead of the workers
+
+    /// Calls the function for each file (with its index in files) from the worker threads.
+    /// The files are read ahead asynchronously (see prefetcher_t) and processed in the order their reads complete.
+    /// Throws the first error (annotated with the file name) after all workers have stopped.
+    void run(const std::function<void(size_t, std::istream&)>& process) const;
+};
+
+/** Number of hardware threads (at least 1). */
+size_t hardware_jobs();
+
+/** Reads the list of trace files in the manifest, one path per line.
+ * Empty lines and lines starting with '#' are skipped, relative paths are relative to the directory of the manifest,
+ * so that the nodes sharing a volume may mount it at different places.
+ * Throws std::runtime_error if the manifest cannot be read. */
+std::vector<std::string> read_manifest(const std::string& path);
+
+/** Selects the files of shard index (from 0) out of count shards, balancing the total file size of the shards:
+ * the files are assigned from the largest to the smallest (equal sizes by path) to the shard with the least total
+ * (equal totals to the lower shard). The assignment depends only on the paths and sizes of the files,
+ * hence nodes sharing the files select disjoint shards covering all files without communicating.
+ * The selected files keep their order. Throws std::runtime_error if the size of a file cannot be determined. */
+std::vector<std::string> select_shard(const std::vector<std::string>& files, size_t index, size_t count);
+
+#endif  // TRACER_BATCH_HPP
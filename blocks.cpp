@@ -0,0 +1,236 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+#include "blocks.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+
+#ifdef TRACER_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+constexpr size_t entry_size = 24;            ///< bytes per index entry
+constexpr size_t entries_per_member = 2048;  ///< index entries per gzip member (the extra field is limited to 64KiB)
+constexpr size_t member_overhead = 26;       ///< bytes of an empty gzip member besides its extra subfield data
+constexpr size_t trailer_size = member_overhead + 24;
+
+void write_u16(std::ostream& os, uint16_t value)
+{
+    const char bytes[] = {char(value), char(value >> 8)};
+    os.write(bytes, sizeof(bytes));
+}
+
+uint32_t read_u16(const char* p) { return uint8_t(p[0]) | uint32_t{uint8_t(p[1])} << 8; }
+
+uint32_t read_u32(const char* p) { return read_u16(p) | read_u16(p + 2) << 16; }
+
+uint64_t read_u64(const char* p) { return read_u32(p) | uint64_t{read_u32(p + 4)} << 32; }
+
+/// Writes an empty gzip member carrying the data in the subfield of its extra field
+void write_member(std::ostream& os, const char* id, const std::string& data)
+{
+    os.write("\x1f\x8b\x08\x04\0\0\0\0\0\xff", 10);  // deflate, FEXTRA, no time, unknown OS
+    write_u16(os, static_cast<uint16_t>(4 + data.size()));
+    os.write(id, 2);
+    write_u16(os, static_cast<uint16_t>(data.size()));
+    os << data;
+    os.write("\x03\0\0\0\0\0\0\0\0\0", 10);  // empty final deflate block, CRC32 and size of no data
+}
+
+/// Parses the empty gzip member written by write_member, returns its data and advances the position
+std::pair<const char*, size_t> read_member(const char*& p, const char* end, const char* id)
+{
+    if (end - p < static_cast<ptrdiff_t>(member_overhead) || std::memcmp(p, "\x1f\x8b\x08\x04", 4) != 0 ||
+        p[12] != id[0] || p[13] != id[1])
+        throw std::runtime_error{"not a block archive"};
+    const auto size = read_u16(p + 14);
+    if (read_u16(p + 10) != 4 + size || end - p < static_cast<ptrdiff_t>(member_overhead + size))
+        throw std::runtime_error{"corrupt block archive index"};
+    const auto* data = p + 16;
+    p = data + size + 10;
+    return {data, size};
+}
+
+#ifdef TRACER_ZLIB
+std::string deflate_block(const std::string& text)
+{
+    auto stream = z_stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error{"failed to initialize zlib"};
+    auto res = std::string(deflateBound(&stream, text.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = text.size();
+    stream.next_out = reinterpret_cast<Bytef*>(res.data());
+    stream.avail_out = res.size();
+    const auto status = deflate(&stream, Z_FINISH);
+    res.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END)
+        throw std::runtime_error{"failed to compress a block"};
+    return res;
+}
+#endif
+}  // namespace
+
+block_writer_t::block_writer_t(std::ostream& os, size_t steps_per_block, size_t jobs):
+    os{os}, steps_per_block{steps_per_block}, jobs{jobs}
+{
+#ifndef TRACER_ZLIB
+    throw std::runtime_error{"block output is not supported: built without zlib"};
+#endif
+}
+
+void block_writer_t::end_step()
+{
+    if (++steps - block_start == steps_per_block)
+        compress();
+}
+
+void block_writer_t::compress()
+{
+#ifdef TRACER_ZLIB
+    auto block = text.str();
+    if (block.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error{"block too large, use fewer steps per block"};
+    index.push_back({0, block_start, 0, static_cast<uint32_t>(block.size())});
+    queue.push_back(std::async(std::launch::async, deflate_block, std::move(block)));
+    text.str({});
+    block_start = steps;
+    while (queue.size() > jobs)
+        write_next();
+#endif
+}
+
+void block_writer_t::write_next()
+{
+    const auto data = queue.front().get();
+    auto& entry = index[index.size() - queue.size()];
+    queue.pop_front();
+    entry.offset = offset;
+    entry.size = static_cast<uint32_t>(data.size());
+    os << data;
+    offset += data.size();
+}
+
+void block_writer_t::finish()
+{
+    if (steps > block_start)
+        compress();
+    while (!queue.empty())
+        write_next();
+    const auto index_offset = offset;
+    for (size_t i = 0; i < index.size(); i += entries_per_member) {
+        auto data = std::ostringstream{};
+        for (auto j = i; j < std::min(index.size(), i + entries_per_member); ++j) {
+            write_u64(data, index[j].offset);
+            write_u64(data, index[j].first_step);
+            write_u32(data, index[j].size);
+            write_u32(data, index[j].length);
+        }
+        write_member(os, "TI", data.str());
+    }
+    auto trailer = std::ostringstream{};
+    write_u64(trailer, index_offset);
+    write_u64(trailer, steps);
+    write_u32(trailer, static_cast<uint32_t>(index.size()));
+    write_u32(trailer, static_cast<uint32_t>(steps_per_block));
+    write_member(os, "TE", trailer.str());
+    os.flush();
+}
+
+block_reader_t::block_reader_t(const std::string& path): file{path}
+{
+    if (file.size() < trailer_size)
+        throw std::runtime_error{path + ": not a block archive"};
+    const auto* end = file.end() - trailer_size;
+    const auto* p = end;
+    const auto [trailer, trailer_length] = read_member(p, file.end(), "TE");
+    if (trailer_length != 24)
+        throw std::runtime_error{path + ": not a block archive"};
+    const auto index_offset = read_u64(trailer);
+    steps = read_u64(trailer + 8);
+    const auto count = read_u32(trailer + 16);
+    if (index_offset > file.size() - trailer_size || count > (file.size() - index_offset) / entry_size)
+        throw std::runtime_error{path + ": corrupt block archive index"};
+    index.reserve(count);
+    for (p = file.begin() + index_offset; p < end;) {
+        const auto [data, size] = read_member(p, end, "TI");
+        for (size_t i = 0; i + entry_size <= size; i += entry_size)
+            index.push_back({read_u64(data + i), read_u64(data + i + 8), read_u32(data + i + 16),
+                             read_u32(data + i + 20)});
+    }
+    for (const auto& entry : index)
+        if (entry.offset + entry.size > index_offset)
+            throw std::runtime_error{path + ": corrupt block archive index"};
+    if (index.size() != count)
+        throw std::runtime_error{path + ": corrupt block archive index"};
+}
+
+std::string block_reader_t::text(size_t block) const
+{
+    const auto& entry = index.at(block);
+    auto res = std::string(entry.length, '\0');
+#ifdef TRACER_ZLIB
+    auto stream = z_stream{};
+    if (inflateInit2(&stream, 15 + 16) != Z_OK)
+        throw std::runtime_error{"failed to initialize zlib"};
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(file.begin() + entry.offset));
+    stream.avail_in = entry.size;
+    stream.next_out = reinterpret_cast<Bytef*>(res.data());
+    stream.avail_out = res.size();
+    const auto status = inflate(&stream, Z_FINISH);
+    const auto length = stream.total_out;
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END || length != entry.length)
+        throw std::runtime_error{"corrupt block at step " + std::to_string(entry.first_step)};
+#else
+    throw std::runtime_error{"block archives are not supported: built without zlib"};
+#endif
+    return res;
+}
+
+void block_reader_t::print(uint64_t from, uint64_t to, std::ostream& os) const
+{
+    if (steps == 0 || from >= steps || from > to)
+        throw std::invalid_argument{"the steps are outside of the trace of " + std::to_string(steps) + " steps"};
+    to = std::min(to, steps - 1);
+    // The first block starting after the step, the previous one contains it.
+    auto block = std::upper_bound(index.begin(), index.end(), from,
+                                  [](uint64_t step, const block_entry_t& e) { return step < e.first_step; }) -
+                 index.begin() - 1;
+    for (auto step = index[block].first_step; step <= to && os; ++block) {
+        const auto text = this->text(block);
+        // Every step but the initial state starts with its transition.
+        for (size_t pos = 0, next; pos < text.size() && step <= to; pos = next, ++step) {
+            next = std::min(text.find("\nTransition: ", pos + 1), text.size());
+            if (step == from && step > 0) {
+                // Start with the state after the transition.
+                const auto state = text.find("\nState: ", pos + 1);
+                if (state < next)
+                    os.write(text.data() + state + 1, next - state - 1);
+            } else if (step >= from) {
+                os.write(text.data() + pos, next - pos);
+            }
+        }
+    }
+    os.flush();
+}
@@ -0,0 +1,95 @@
+#ifndef TRACER_BLOCKS_HPP
+#define TRACER_BLOCKS_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "io.hpp"
+
+#include <deque>
+#include <future>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/** Block archive of the rendered trace: the text of every steps_per_block consecutive steps is compressed
+ * independently as a gzip member, followed by an index of the blocks, so that any range of steps can be
+ * decompressed without the rest. The index is stored in the extra fields of empty gzip members,
+ * hence the whole archive is also a valid gzip file of the complete text (e.g. for zcat). */
+struct block_entry_t
+{
+    uint64_t offset;      ///< position of the compressed block in the archive
+    uint64_t first_step;  ///< number of the first step in the block (the initial state is step 0)
+    uint32_t size;        ///< compressed size
+    uint32_t length;      ///< text size
+};
+
+/** Writes the block archive: steps are rendered into the current block,
+ * full blocks are compressed in parallel on worker threads and written in order. */
+class block_writer_t
+{
+    std::ostream& os;
+    size_t steps_per_block;
+    size_t jobs;
+    std::ostringstream text;                     ///< the current block
+    std::deque<std::future<std::string>> queue;  ///< blocks being compressed, in order
+    std::vector<block_entry_t> index;
+    uint64_t offset{0};       ///< bytes written
+    uint64_t steps{0};        ///< steps rendered
+    uint64_t block_start{0};  ///< first step of the current block
+
+    void compress();    ///< submits the current block for compression
+    void write_next();  ///< waits for the oldest block and writes it
+
+public:
+    /// Throws std::runtime_error if built without zlib
+    block_writer_t(std::ostream& os, size_t steps_per_block, size_t jobs);
+    block_writer_t(const block_writer_t&) = delete;
+    block_writer_t& operator=(const block_writer_t&) = delete;
+    /// Stream for rendering the next step
+    std::ostream& step() { return text; }
+    /// Ends the rendered step
+    void end_step();
+    /// Writes the remaining blocks and the index
+    void finish();
+};
+
+/** Reads the index of the block archive and decompresses its blocks on demand. */
+class block_reader_t
+{
+    mapped_file_t file;
+    std::vector<block_entry_t> index;
+    uint64_t steps{0};
+
+public:
+    /// Reads the index, throws std::runtime_error if the file is not a block archive
+    explicit block_reader_t(const std::string& path);
+    const std::vector<block_entry_t>& blocks() const { return index; }
+    /// Number of steps in the archive (including the initial state)
+    uint64_t step_count() const { return steps; }
+    /// Decompresses the text of the block
+    std::string text(size_t block) const;
+    /// Prints the state after step from followed by the steps until step to (inclusive),
+    /// in the same format as the text output of the trace.
+    void print(uint64_t from, uint64_t to, std::ostream& os) const;
+};
+
+#endif  // TRACER_BLOCKS_HPP
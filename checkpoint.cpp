@@ -0,0 +1,136 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+#include "checkpoint.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr auto magic = "tracer checkpoint 1";
+}
+
+void checkpoint_t::identify(const std::string& trace)
+{
+    trace_size = std::filesystem::file_size(trace);
+    trace_time = std::filesystem::last_write_time(trace).time_since_epoch().count();
+}
+
+void checkpoint_t::save(const model_t& model, const std::string& path) const
+{
+    const auto temporary = path + ".tmp";
+    {
+        auto os = std::ofstream{temporary};
+        if (!os)
+            throw std::runtime_error{temporary + ": " + std::strerror(errno)};
+        os << magic << '\n';
+        os << "trace " << trace_size << ' ' << trace_time << '\n';
+        os << "settings " << settings << '\n';
+        os << "offset " << offset << '\n';
+        os << "step " << step << '\n';
+        os << "kept " << kept << '\n';
+        os << "output " << output << '\n';
+        state.write(model, os);
+        os.flush();
+        if (!os)
+            throw std::runtime_error{temporary + ": " + std::strerror(errno)};
+    }
+    auto error = std::error_code{};
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+        throw std::runtime_error{path + ": " + error.message()};
+}
+
+bool checkpoint_t::load(const model_t& model, const std::string& path)
+{
+    auto is = std::ifstream{path};
+    if (!is) {
+        if (errno == ENOENT)
+            return false;
+        throw std::runtime_error{path + ": " + std::strerror(errno)};
+    }
+    auto line = std::string{};
+    auto field = [&](const char* name) -> std::istream& {
+        auto word = std::string{};
+        if (!(is >> word) || word != name)
+            throw std::runtime_error{path + ": not a checkpoint"};
+        return is;
+    };
+    if (!std::getline(is, line) || line != magic)
+        throw std::runtime_error{path + ": not a checkpoint"};
+    field("trace") >> trace_size >> trace_time;
+    field("settings");
+    is.get();  // the space before the settings, which may be empty
+    std::getline(is, settings);
+    field("offset") >> offset;
+    field("step") >> step;
+    field("kept") >> kept;
+    field("output") >> output;
+    if (!is)
+        throw std::runtime_error{path + ": not a checkpoint"};
+    try {
+        state.read(model, is);
+    } catch (std::runtime_error& e) {
+        throw std::runtime_error{path + ": " + e.what()};
+    }
+    if (!is || state.locations.size() != model.processes.size())
+        throw std::runtime_error{path + ": not a checkpoint of the model"};
+    return true;
+}
+
+#ifdef _WIN32
+
+int64_t output_position() { return -1; }
+
+void truncate_output(int64_t) {}
+
+#else
+
+int64_t output_position()
+{
+    std::cout.flush();
+    std::fflush(stdout);
+    struct stat info;
+    if (fstat(STDOUT_FILENO, &info) != 0 || !S_ISREG(info.st_mode))
+        return -1;
+    return lseek(STDOUT_FILENO, 0, SEEK_CUR);
+}
+
+void truncate_output(int64_t position)
+{
+    struct stat info;
+    if (position < 0 || fstat(STDOUT_FILENO, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < position)
+        return;
+    std::cout.flush();
+    std::fflush(stdout);
+    if (ftruncate(STDOUT_FILENO, position) != 0 || lseek(STDOUT_FILENO, position, SEEK_SET) < 0)
+        throw std::runtime_error{std::string{"cannot truncate the output: "} + std::strerror(errno)};
+}
+
+#endif
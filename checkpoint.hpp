@@ -0,0 +1,65 @@
+#ifndef TRACER_CHECKPOINT_HPP
+#define TRACER_CHECKPOINT_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "tracer.hpp"
+
+#include <string>
+#include <cstdint>
+
+/** Progress of printing a trace, saved periodically so that an interrupted run over a huge trace
+ * can be resumed at the last checkpoint: the input is positioned after the last step read instead of parsing
+ * the steps before it again. */
+struct checkpoint_t
+{
+    uint64_t trace_size{0};  ///< size of the trace file
+    int64_t trace_time{0};   ///< modification time of the trace file
+    std::string settings;    ///< the options affecting the output, which must not change when resuming
+    uint64_t offset{0};      ///< input position after the last step read
+    uint64_t step{0};        ///< number of steps read
+    uint64_t kept{0};        ///< number of steps kept by the slice (counted for sampling)
+    int64_t output{-1};      ///< output position after the last step printed, -1 if the output is not a regular file
+    State state;             ///< the last state read
+
+    /// Records the size and the modification time of the trace file, throws std::system_error upon failure
+    void identify(const std::string& trace);
+    /// True if the trace file is the one identified by the checkpoint
+    bool same_trace(const checkpoint_t& other) const
+    {
+        return trace_size == other.trace_size && trace_time == other.trace_time;
+    }
+    /// Writes the checkpoint into a temporary file which then replaces the file at path,
+    /// so that an interruption leaves either the previous or the new checkpoint.
+    /// Throws std::runtime_error upon failure.
+    void save(const model_t&, const std::string& path) const;
+    /// Reads the checkpoint, returns false if the file does not exist.
+    /// Throws std::runtime_error if the file is not a checkpoint of the model.
+    bool load(const model_t&, const std::string& path);
+};
+
+/** Position of the standard output (after flushing it) if it is a regular file, -1 otherwise. */
+int64_t output_position();
+
+/** Cuts the standard output back to the position if it is a regular file at least as long,
+ * so that the output printed after a checkpoint is not repeated when resuming. */
+void truncate_output(int64_t position);
+
+#endif  // TRACER_CHECKPOINT_HPP
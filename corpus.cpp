@@ -0,0 +1,636 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "corpus.hpp"
+
+#include "io.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <cstring>
+
+/// Transition ID marking the initial state nodes
+static constexpr uint32_t no_transition = std::numeric_limits<uint32_t>::max();
+
+namespace {
+/** Orders the states by their contents, so that the output does not depend on the store IDs,
+ * which depend on the order in which the worker threads interned the arrays. */
+bool less_state(const State& a, const State& b)
+{
+    if (a.locations != b.locations)
+        return a.locations < b.locations;
+    if (a.integers != b.integers)
+        return a.integers < b.integers;
+    return std::lexicographical_compare(a.dbm.begin(), a.dbm.end(), b.dbm.begin(), b.dbm.end(),
+                                        [](bound_t x, bound_t y) {
+                                            return x.value != y.value ? x.value < y.value : x.strict < y.strict;
+                                        });
+}
+
+/** Orders the transitions by their contents (see less_state). */
+bool less_transition(const Transition& a, const Transition& b)
+{
+    return std::lexicographical_compare(a.edges.begin(), a.edges.end(), b.edges.begin(), b.edges.end(),
+                                        [](const Edge& x, const Edge& y) {
+                                            return std::tie(x.process, x.edge, x.select) <
+                                                   std::tie(y.process, y.edge, y.select);
+                                        });
+}
+
+/** Writes states and transitions of a store into a shard result. Every distinct array is written once:
+ * a reference is the number of the array (in the order of appearance) followed by the array where it appears first. */
+class shard_writer_t
+{
+    std::ostream& os;
+    const shared_state_store_t& store;
+    std::unordered_map<uint32_t, uint32_t> locations, integers, dbms, transitions;  ///< store ID -> number
+    State state;
+    Transition transition;
+
+    /// Writes the reference to the array, returns true if the array has to follow
+    static bool reference(std::ostream& os, std::unordered_map<uint32_t, uint32_t>& numbers, uint32_t id)
+    {
+        const auto [it, added] = numbers.try_emplace(id, numbers.size());
+        write_u32(os, it->second);
+        return added;
+    }
+    template <typename T>
+    void write_array(const std::vector<T>& values)
+    {
+        static_assert(sizeof(T) == sizeof(uint32_t));
+        write_u32(os, values.size());
+        for (const auto& value : values) {
+            auto word = uint32_t{};
+            std::memcpy(&word, &value, sizeof(word));
+            write_u32(os, word);
+        }
+    }
+
+public:
+    shard_writer_t(std::ostream& os, const shared_state_store_t& store): os{os}, store{store} {}
+    void write(state_id_t id)
+    {
+        if (locations.count(id.locations) == 0 || integers.count(id.integers) == 0 || dbms.count(id.dbm) == 0)
+            store.load(id, state);
+        if (reference(os, locations, id.locations))
+            write_array(state.locations);
+        if (reference(os, integers, id.integers))
+            write_array(state.integers);
+        if (reference(os, dbms, id.dbm))
+            write_array(state.dbm);
+    }
+    void write_transition(uint32_t id)
+    {
+        if (id == no_transition) {
+            write_u32(os, no_transition);
+        } else if (reference(os, transitions, id)) {
+            store.load(id, transition);
+            write_u32(os, transition.edges.size());
+            for (const auto& e : transition.edges) {
+                write_u32(os, e.process);
+                write_u32(os, e.edge);
+                write_array(e.select);
+            }
+        }
+    }
+};
+
+/** Reads the states and transitions written by shard_writer_t into a store. */
+class shard_reader_t
+{
+    std::istream& is;
+    const model_t& model;
+    shared_state_store_t& store;
+    std::vector<std::vector<int>> locations, integers;
+    std::vector<std::vector<bound_t>> dbms;
+    std::vector<uint32_t> transitions;  ///< store IDs by number
+    State state;
+    Transition transition;
+
+    static std::runtime_error corrupt() { return std::runtime_error{"corrupt shard result"}; }
+
+    /// Reads an array of at most max_size values
+    template <typename T>
+    void read_array(std::vector<T>& values, size_t max_size)
+    {
+        const auto size = read_u32(is);
+        if (size > max_size)
+            throw corrupt();
+        values.resize(size);
+        for (auto& value : values) {
+            const auto word = read_u32(is);
+            std::memcpy(&value, &word, sizeof(word));
+        }
+    }
+    /// Reads a reference to an array of the size, returns the array
+    template <typename T>
+    const std::vector<T>& read_reference(std::vector<std::vector<T>>& arrays, size_t size)
+    {
+        const auto number = read_u32(is);
+        if (number == arrays.size()) {
+            read_array(arrays.emplace_back(), size);
+            if (arrays.back().size() != size)
+                throw corrupt();
+        } else if (number > arrays.size()) {
+            throw corrupt();
+        }
+        return arrays[number];
+    }
+
+public:
+    shard_reader_t(std::istream& is, const model_t& model, shared_state_store_t& store):
+        is{is}, model{model}, store{store}
+    {}
+    /// Reads a state and stores it
+    state_id_t read()
+    {
+        state.locations = read_reference(locations, model.processes.size());
+        state.integers = read_reference(integers, model.integers.size());
+        state.dbm = read_reference(dbms, model.clocks.size() * model.clocks.size());
+        return store.intern(state);
+    }
+    /// Reads a transition and stores it
+    uint32_t read_transition()
+    {
+        const auto number = read_u32(is);
+        if (number == no_transition)
+            return no_transition;
+        if (number == transitions.size()) {
+            const auto count = read_u32(is);
+            if (count > model.processes.size())
+                throw corrupt();
+            transition.edges.resize(count);
+            for (auto& e : transition.edges) {
+                e.process = static_cast<int>(read_u32(is));
+                e.edge = static_cast<int>(read_u32(is));
+                read_array(e.select, std::numeric_limits<uint16_t>::max());
+            }
+            transitions.push_back(store.intern(transition));
+        } else if (number > transitions.size()) {
+            throw corrupt();
+        }
+        return transitions[number];
+    }
+};
+}  // namespace
+
+trace_trie_t::trace_trie_t()
+{
+    chunks.resize(size_t{1} << (32 - chunk_bits));
+    allocate(root, step_id_t{no_transition});
+}
+
+trace_trie_t::node_id_t trace_trie_t::allocate(node_id_t parent, const step_id_t& step)
+{
+    auto lock = std::lock_guard{alloc_mutex};
+    const auto id = size.load();
+    if (id >= std::numeric_limits<node_id_t>::max())
+        throw std::length_error{"too many trace prefixes"};
+    auto& chunk = chunks[id >> chunk_bits];
+    if (!chunk)
+        chunk = std::make_unique<node_t[]>(chunk_size);
+    auto& n = chunk[id & (chunk_size - 1)];
+    n.step = step;
+    n.parent = parent;
+    n.depth = (id == root || parent == root) ? 0 : node(parent).depth + 1;
+    size = id + 1;
+    return id;
+}
+
+trace_trie_t::node_id_t trace_trie_t::child(node_id_t parent, const step_id_t& step, uint32_t traces)
+{
+    auto lock = std::lock_guard{locks[parent % lock_count]};
+    auto& p = node(parent);
+    for (auto c : p.children) {
+        auto& n = node(c);
+        if (n.step == step) {
+            n.traces += traces;
+            return c;
+        }
+    }
+    const auto c = allocate(parent, step);
+    node(c).traces = traces;
+    p.children.push_back(c);
+    return c;
+}
+
+void trace_trie_t::insert(const model_t& model, std::istream& is)
+{
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    auto id = child(root, step_id_t{no_transition, store.intern(step.state)});
+    auto steps = size_t{0};
+    for (; reader.next(step); ++steps)
+        id = child(id, store.intern(step));
+    {
+        auto lock = std::lock_guard{locks[id % lock_count]};
+        ++node(id).ends;
+    }
+    ++trace_count;
+    step_count += steps;
+}
+
+trace_trie_t::stats_t trace_trie_t::stats() const
+{
+    auto res = stats_t{};
+    res.traces = trace_count;
+    res.steps = step_count;
+    res.nodes = size - 1;
+    res.locations = store.location_count();
+    res.integers = store.integer_count();
+    res.dbms = store.dbm_count();
+    res.transitions = store.transition_count();
+    res.memory = store.memory() + chunks.capacity() * sizeof(chunks[0]);
+    res.memory += ((size + chunk_size - 1) / chunk_size) * chunk_size * sizeof(node_t);
+    for (node_id_t id = 0; id < size; ++id) {
+        const auto& n = node(id);
+        if (n.children.size() + (n.ends > 0 ? 1 : 0) > 1)
+            ++res.divergences;
+        if (id != root)
+            res.max_depth = std::max<size_t>(res.max_depth, n.depth);
+        res.memory += n.children.capacity() * sizeof(node_id_t);
+    }
+    return res;
+}
+
+std::ostream& trace_trie_t::print_stats(std::ostream& os) const
+{
+    const auto s = stats();
+    os << "Traces: " << s.traces << '\n';
+    os << "Steps: " << s.steps << '\n';
+    os << "Distinct prefixes: " << s.nodes << '\n';
+    os << "Divergence points: " << s.divergences << '\n';
+    os << "Longest trace: " << s.max_depth << " steps\n";
+    os << "Distinct location vectors: " << s.locations << '\n';
+    os << "Distinct integer vectors: " << s.integers << '\n';
+    os << "Distinct DBMs: " << s.dbms << '\n';
+    os << "Distinct transitions: " << s.transitions << '\n';
+    os << "Memory: " << s.memory << " bytes\n";
+    return os;
+}
+
+std::ostream& trace_trie_t::write_shard(std::ostream& os) const
+{
+    write_u64(os, trace_count);
+    write_u64(os, step_count);
+    write_u32(os, size - 1);
+    auto writer = shard_writer_t{os, store};
+    // Parents are allocated before their children, hence they precede them.
+    for (node_id_t id = 1; id < size; ++id) {
+        const auto& n = node(id);
+        write_u32(os, n.parent);
+        write_u32(os, n.traces);
+        write_u32(os, n.ends);
+        writer.write_transition(n.step.transition);
+        writer.write(n.step.state);
+    }
+    return os;
+}
+
+void trace_trie_t::merge(const model_t& model, std::istream& is)
+{
+    const auto traces = read_u64(is);
+    const auto steps = read_u64(is);
+    const auto count = read_u32(is);
+    auto reader = shard_reader_t{is, model, store};
+    auto ids = std::vector<node_id_t>{root};  // shard node -> node
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto parent = read_u32(is);
+        const auto passing = read_u32(is);
+        const auto ends = read_u32(is);
+        if (parent >= ids.size())
+            throw std::runtime_error{"corrupt shard result"};
+        const auto transition = reader.read_transition();
+        const auto id = child(ids[parent], step_id_t{transition, reader.read()}, passing);
+        node(id).ends += ends;
+        ids.push_back(id);
+    }
+    trace_count += traces;
+    step_count += steps;
+}
+
+std::ostream& trace_trie_t::print_divergences(const model_t& model, std::ostream& os) const
+{
+    // Steps are ordered by their contents: the node IDs depend on the scheduling of the inserting threads.
+    auto state = State{}, other_state = State{};
+    auto transition = Transition{}, other_transition = Transition{};
+    auto less_step = [&](node_id_t a, node_id_t b) {
+        const auto& sa = node(a).step;
+        const auto& sb = node(b).step;
+        if (sa.transition != sb.transition) {
+            store.load(sa.transition, transition);
+            store.load(sb.transition, other_transition);
+            if (less_transition(transition, other_transition))
+                return true;
+            if (less_transition(other_transition, transition))
+                return false;
+        }
+        store.load(sa.state, state);
+        store.load(sb.state, other_state);
+        return less_state(state, other_state);
+    };
+    // Nodes of equal depth are ordered by the steps where their paths from the initial state part.
+    auto less_path = [&](node_id_t a, node_id_t b) {
+        if (a == root || b == root)
+            return a == root && b != root;  // the initial states come first
+        if (node(a).depth != node(b).depth)
+            return node(a).depth < node(b).depth;
+        while (a != b && node(a).parent != node(b).parent) {
+            a = node(a).parent;
+            b = node(b).parent;
+        }
+        return a != b && less_step(a, b);
+    };
+    auto points = std::vector<node_id_t>{};
+    for (node_id_t id = 0; id < size; ++id)
+        if (const auto& n = node(id); n.children.size() + (n.ends > 0 ? 1 : 0) > 1)
+            points.push_back(id);
+    std::sort(points.begin(), points.end(), less_path);
+    auto children = std::vector<node_id_t>{};
+    for (auto id : points) {
+        const auto& n = node(id);
+        if (id == root)
+            os << "Initial states differ (" << trace_count << " traces):\n";
+        else
+            os << "Divergence after step " << n.depth << " (" << n.traces << " traces):\n";
+        children = n.children;
+        std::sort(children.begin(), children.end(), less_step);
+        for (auto c : children) {
+            const auto& child = node(c);
+            os << '\t' << child.traces << (child.traces == 1 ? " trace: " : " traces: ");
+            if (id == root) {
+                store.load(child.step.state, state);
+                state.print(model, os << "State: ") << '\n';
+            } else {
+                store.load(child.step.transition, transition);
+                transition.print(model, os << "Transition: ") << '\n';
+            }
+        }
+        if (n.ends > 0)
+            os << '\t' << n.ends << (n.ends == 1 ? " trace ends\n" : " traces end\n");
+    }
+    return os;
+}
+
+void state_graph_t::insert(const model_t& model, std::istream& is)
+{
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    auto source = store.intern(step.state);
+    auto visit = [](uint32_t& visits, bool) { ++visits; };
+    nodes.update(source, visit);
+    while (reader.next(step)) {
+        const auto id = store.intern(step);
+        nodes.update(id.state, visit);
+        edges.update(graph_edge_t{source, id.transition, id.state}, visit);
+        source = id.state;
+    }
+}
+
+std::ostream& state_graph_t::write_shard(std::ostream& os) const
+{
+    auto writer = shard_writer_t{os, store};
+    auto numbers = std::unordered_map<state_id_t, uint32_t>{};
+    write_u32(os, nodes.size());
+    nodes.for_each([&](const state_id_t& id, uint32_t visits) {
+        numbers.emplace(id, numbers.size());
+        writer.write(id);
+        write_u32(os, visits);
+    });
+    write_u32(os, edges.size());
+    edges.for_each([&](const graph_edge_t& e, uint32_t traversals) {
+        write_u32(os, numbers.at(e.source));
+        write_u32(os, numbers.at(e.target));
+        writer.write_transition(e.transition);
+        write_u32(os, traversals);
+    });
+    return os;
+}
+
+void state_graph_t::merge(const model_t& model, std::istream& is)
+{
+    auto reader = shard_reader_t{is, model, store};
+    auto ids = std::vector<state_id_t>(read_u32(is));  // shard node -> state
+    for (auto& id : ids) {
+        id = reader.read();
+        nodes.update(id, [visits = read_u32(is)](uint32_t& count, bool) { count += visits; });
+    }
+    for (auto count = read_u32(is); count > 0; --count) {
+        const auto source = read_u32(is);
+        const auto target = read_u32(is);
+        if (source >= ids.size() || target >= ids.size())
+            throw std::runtime_error{"corrupt shard result"};
+        const auto transition = reader.read_transition();
+        const auto edge = graph_edge_t{ids[source], transition, ids[target]};
+        edges.update(edge, [traversals = read_u32(is)](uint32_t& n, bool) { n += traversals; });
+    }
+}
+
+std::ostream& write_shard_header(const model_t& model, const shard_header_t& header, std::ostream& os)
+{
+    os.write("TRACERS", 8);  // including the terminating zero
+    write_u32(os, 1);        // version
+    write_u32(os, header.kind);
+    write_u32(os, header.index);
+    write_u32(os, header.count);
+    write_u32(os, model.processes.size());
+    write_u32(os, model.integers.size());
+    write_u32(os, model.clocks.size());
+    return os;
+}
+
+shard_header_t read_shard_header(const model_t& model, std::istream& is)
+{
+    char magic[8];
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, "TRACERS", 8) != 0 || read_u32(is) != 1)
+        throw std::runtime_error{"not a shard result"};
+    auto res = shard_header_t{};
+    const auto kind = read_u32(is);
+    res.index = read_u32(is);
+    res.count = read_u32(is);
+    if (kind > shard_header_t::graph || res.index >= res.count)
+        throw std::runtime_error{"corrupt shard result"};
+    res.kind = static_cast<shard_header_t::kind_t>(kind);
+    if (read_u32(is) != model.processes.size() || read_u32(is) != model.integers.size() ||
+        read_u32(is) != model.clocks.size())
+        throw std::runtime_error{"shard result of another model"};
+    return res;
+}
+
+namespace {
+/** Dense numbering of the graph for output. */
+struct numbering_t
+{
+    std::vector<std::pair<state_id_t, uint32_t>> nodes;  ///< state and visits ordered by node number
+    std::unordered_map<state_id_t, uint32_t> node_index;
+    std::vector<std::pair<graph_edge_t, uint32_t>> edges;  ///< edges and traversals ordered by source node
+    std::vector<uint32_t> transitions;                     ///< transition IDs in order of their numbers
+    std::unordered_map<uint32_t, uint32_t> transition_index;
+};
+
+/** Numbers the nodes, transitions and edges in the order of their content hashes (and of their contents if the hashes
+ * are equal, see less_state), so that the output is the same regardless of the number of threads and their scheduling.
+ * The states and transitions are loaded only to break such ties, not copied out of the store. */
+template <typename Nodes, typename Edges>
+numbering_t number(const shared_state_store_t& store, const Nodes& nodes, const Edges& edges)
+{
+    auto res = numbering_t{};
+    nodes.for_each([&res](const state_id_t& id, uint32_t visits) { res.nodes.emplace_back(id, visits); });
+    auto hashes = std::vector<uint64_t>(res.nodes.size());
+    for (uint32_t i = 0; i < res.nodes.size(); ++i)
+        hashes[i] = store.hash(res.nodes[i].first);
+    auto order = std::vector<uint32_t>(res.nodes.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto a_state = State{}, b_state = State{};
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (hashes[a] != hashes[b])
+            return hashes[a] < hashes[b];
+        store.load(res.nodes[a].first, a_state);
+        store.load(res.nodes[b].first, b_state);
+        return less_state(a_state, b_state);
+    });
+    hashes = {};
+    auto sorted = std::vector<std::pair<state_id_t, uint32_t>>{};
+    sorted.reserve(order.size());
+    for (auto i : order)
+        sorted.push_back(res.nodes[i]);
+    res.nodes = std::move(sorted);
+    for (uint32_t i = 0; i < res.nodes.size(); ++i)
+        res.node_index.emplace(res.nodes[i].first, i);
+
+    edges.for_each([&res](const graph_edge_t& e, uint32_t count) {
+        res.edges.emplace_back(e, count);
+        if (res.transition_index.emplace(e.transition, 0).second)
+            res.transitions.push_back(e.transition);
+    });
+    auto a_transition = Transition{}, b_transition = Transition{};
+    std::sort(res.transitions.begin(), res.transitions.end(), [&](uint32_t a, uint32_t b) {
+        const auto a_hash = store.hash(a), b_hash = store.hash(b);
+        if (a_hash != b_hash)
+            return a_hash < b_hash;
+        store.load(a, a_transition);
+        store.load(b, b_transition);
+        return less_transition(a_transition, b_transition);
+    });
+    for (uint32_t i = 0; i < res.transitions.size(); ++i)
+        res.transition_index[res.transitions[i]] = i;
+    std::sort(res.edges.begin(), res.edges.end(), [&res](const auto& a, const auto& b) {
+        const auto& ea = a.first;
+        const auto& eb = b.first;
+        return std::make_tuple(res.node_index.at(ea.source), res.transition_index.at(ea.transition),
+                               res.node_index.at(ea.target)) <
+               std::make_tuple(res.node_index.at(eb.source), res.transition_index.at(eb.transition),
+                               res.node_index.at(eb.target));
+    });
+    return res;
+}
+
+/** Writes the text as a DOT string literal. */
+void write_quoted(std::ostream& os, const std::string& text)
+{
+    os << '"';
+    for (auto c : text) {
+        if (c == '"' || c == '\\')
+            os << '\\';
+        os << c;
+    }
+    os << '"';
+}
+
+}  // namespace
+
+std::ostream& state_graph_t::write_dot(const model_t& model, std::ostream& os) const
+{
+    const auto g = number(store, nodes, edges);
+    auto state = State{};
+    auto transition = Transition{};
+    auto text = std::ostringstream{};
+    os << "digraph states {\n";
+    for (uint32_t i = 0; i < g.nodes.size(); ++i) {
+        store.load(g.nodes[i].first, state);
+        text.str({});
+        state.print(model, text);
+        os << "\tn" << i << " [label=";
+        write_quoted(os, text.str());
+        os << ", visits=" << g.nodes[i].second << "];\n";
+    }
+    for (const auto& [e, count] : g.edges) {
+        store.load(e.transition, transition);
+        text.str({});
+        transition.print(model, text);
+        os << "\tn" << g.node_index.at(e.source) << " -> n" << g.node_index.at(e.target) << " [label=";
+        write_quoted(os, text.str());
+        os << ", traversals=" << count << "];\n";
+    }
+    return os << "}\n";
+}
+
+std::ostream& state_graph_t::write_binary(const model_t& model, std::ostream& os) const
+{
+    const auto g = number(store, nodes, edges);
+    os.write("TRACERG", 8);  // including the terminating zero
+    write_u32(os, 2);        // version
+    write_u32(os, model.processes.size());
+    write_u32(os, model.integers.size());
+    write_u32(os, g.nodes.size());
+    write_u32(os, g.edges.size());
+    write_u32(os, g.transitions.size());
+    auto state = State{};
+    for (const auto& [id, visits] : g.nodes) {
+        store.load(id, state);
+        for (auto l : state.locations)
+            write_u32(os, l);
+        for (auto v : state.integers)
+            write_u32(os, v);
+    }
+    for (const auto& [id, visits] : g.nodes)
+        write_u32(os, visits);
+    // Edges are ordered by source, hence the source is given by offsets (compressed sparse rows).
+    auto offset = uint32_t{0};
+    for (uint32_t i = 0; i < g.nodes.size(); ++i) {
+        write_u32(os, offset);
+        while (offset < g.edges.size() && g.node_index.at(g.edges[offset].first.source) == i)
+            ++offset;
+    }
+    write_u32(os, offset);
+    for (const auto& [e, count] : g.edges) {
+        write_u32(os, g.node_index.at(e.target));
+        write_u32(os, g.transition_index.at(e.transition));
+        write_u32(os, count);
+    }
+    auto transition = Transition{};
+    for (auto id : g.transitions) {
+        store.load(id, transition);
+        write_u32(os, transition.edges.size());
+        for (const auto& e : transition.edges) {
+            write_u32(os, e.process);
+            write_u32(os, e.edge);
+            write_u32(os, e.select.size());
+            for (auto v : e.select)
+                write_u32(os, v);
+        }
+    }
+    return os;
+}
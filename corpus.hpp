@@ -0,0 +1,167 @@
+#ifndef TRACER_CORPUS_HPP
+#define TRACER_CORPUS_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "tracer.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/** Prefix trie of traces over the same model: each node is a step keyed by (transition, state),
+ * so traces sharing a prefix share its nodes and the memory grows with the distinct behavior only.
+ * Traces can be inserted concurrently from several threads. */
+class trace_trie_t
+{
+public:
+    using node_id_t = uint32_t;
+    static constexpr node_id_t root = 0;  ///< virtual node whose children are the initial states
+
+    struct node_t
+    {
+        step_id_t step{};                ///< the step leading to the node (only the state for initial states)
+        node_id_t parent{root};          ///< the previous step
+        uint32_t depth{0};               ///< number of steps from the initial state
+        uint32_t traces{0};              ///< number of traces passing through the node
+        uint32_t ends{0};                ///< number of traces ending at the node
+        std::vector<node_id_t> children;  ///< following steps
+    };
+
+    /// Statistics over the inserted traces
+    struct stats_t
+    {
+        size_t traces{0};             ///< number of traces
+        size_t steps{0};              ///< total number of steps in all traces
+        size_t nodes{0};              ///< number of distinct trace prefixes (trie nodes)
+        size_t divergences{0};        ///< number of nodes where traces continue differently
+        size_t max_depth{0};          ///< length of the longest trace
+        size_t locations{0};          ///< distinct location vectors
+        size_t integers{0};           ///< distinct integer vectors
+        size_t dbms{0};               ///< distinct DBMs
+        size_t transitions{0};        ///< distinct transitions
+        size_t memory{0};             ///< bytes used by the trie and the store
+    };
+
+private:
+    static constexpr size_t chunk_bits = 16;
+    static constexpr size_t chunk_size = size_t{1} << chunk_bits;
+    static constexpr size_t lock_count = 256;
+    std::vector<std::unique_ptr<node_t[]>> chunks;  ///< node storage, reserved upfront so it never moves
+    std::atomic<size_t> size{0};                     ///< number of nodes
+    std::mutex alloc_mutex;
+    std::array<std::mutex, lock_count> locks;        ///< guard the children of nodes (striped by node ID)
+    std::atomic<size_t> trace_count{0};
+    std::atomic<size_t> step_count{0};
+
+    node_id_t allocate(node_id_t parent, const step_id_t& step);
+
+public:
+    shared_state_store_t store;  ///< states and transitions of all traces
+
+    trace_trie_t();
+    node_t& node(node_id_t id) { return chunks[id >> chunk_bits][id & (chunk_size - 1)]; }
+    const node_t& node(node_id_t id) const { return chunks[id >> chunk_bits][id & (chunk_size - 1)]; }
+    /// Number of nodes including the root
+    size_t node_count() const { return size; }
+
+    /// Returns the child of the node following the step, adds it if it is new. Counts the traces passing.
+    node_id_t child(node_id_t parent, const step_id_t& step, uint32_t traces = 1);
+    /// Reads the trace and adds it to the trie step by step. Thread-safe.
+    void insert(const model_t& model, std::istream& is);
+    /// Returns the statistics, must not be called while inserting
+    stats_t stats() const;
+    /// Prints the statistics
+    std::ostream& print_stats(std::ostream&) const;
+    /// Prints the nodes with several continuations: the depth, the number of traces and the alternative steps
+    std::ostream& print_divergences(const model_t&, std::ostream&) const;
+    /// Writes the nodes and counters as a shard result (after write_shard_header), must not be called while inserting
+    std::ostream& write_shard(std::ostream&) const;
+    /// Adds the traces of a shard result written by write_shard, throws std::runtime_error upon malformed input
+    void merge(const model_t&, std::istream&);
+};
+
+/** An edge of the state graph: a transition between two states. */
+struct graph_edge_t
+{
+    state_id_t source{};
+    uint32_t transition{0};
+    state_id_t target{};
+    bool operator==(const graph_edge_t& o) const
+    {
+        return source == o.source && transition == o.transition && target == o.target;
+    }
+};
+
+template <>
+struct std::hash<graph_edge_t>
+{
+    size_t operator()(const graph_edge_t& e) const noexcept
+    {
+        const auto h = std::hash<state_id_t>{};
+        return h(e.source) ^ (h(e.target) * 0xC2B2AE3D27D4EB4Full) ^ (e.transition * 0x165667B19E3779F9ull);
+    }
+};
+
+/** Reachability graph reconstructed from many traces over the same model:
+ * the nodes are distinct symbolic states and the edges are transitions between them.
+ * Traces can be added concurrently from several threads. */
+class state_graph_t
+{
+    concurrent_map_t<state_id_t, uint32_t> nodes;    ///< state -> number of visits
+    concurrent_map_t<graph_edge_t, uint32_t> edges;  ///< edge -> number of traversals
+
+public:
+    shared_state_store_t store;  ///< states and transitions of all traces
+
+    /// Reads the trace and adds its states and transitions. Thread-safe.
+    void insert(const model_t& model, std::istream& is);
+    size_t node_count() const { return nodes.size(); }
+    size_t edge_count() const { return edges.size(); }
+    /// Writes the graph in Graphviz DOT format, nodes are labeled by states and edges by transitions.
+    std::ostream& write_dot(const model_t&, std::ostream&) const;
+    /// Writes the graph in a compact binary adjacency format (see README).
+    std::ostream& write_binary(const model_t&, std::ostream&) const;
+    /// Writes the states and transitions with their counts as a shard result (after write_shard_header)
+    std::ostream& write_shard(std::ostream&) const;
+    /// Adds the states and transitions of a shard result written by write_shard,
+    /// throws std::runtime_error upon malformed input
+    void merge(const model_t&, std::istream&);
+};
+
+/** Identifies the result of one shard of a corpus or graph command, to be merged with the other shards. */
+struct shard_header_t
+{
+    enum kind_t : uint32_t { corpus, graph };
+    kind_t kind{corpus};
+    uint32_t index{0};  ///< shard number from 0
+    uint32_t count{1};  ///< number of shards
+};
+
+/** Writes the header of a shard result, including the model dimensions. */
+std::ostream& write_shard_header(const model_t&, const shard_header_t&, std::ostream&);
+
+/** Reads the header of a shard result, throws std::runtime_error if it is not a shard result of the model. */
+shard_header_t read_shard_header(const model_t&, std::istream&);
+
+#endif  // TRACER_CORPUS_HPP
@@ -0,0 +1,219 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "diff.hpp"
+
+#include <future>
+#include <memory>
+#include <cstddef>
+
+namespace {
+/** State of the middle snake search shared by the recursion: the furthest reaching paths
+ * of the forward and the backward search indexed by diagonal around the middle of the arrays. */
+struct myers_t
+{
+    const uint32_t* a;
+    const uint32_t* b;
+    std::vector<ptrdiff_t> forward, backward;
+    std::vector<std::pair<size_t, size_t>>& matches;
+
+    /// Finds the middle snake of a[x0,x1) and b[y0,y1) which are non-empty and differ at both ends.
+    /// @returns the snake start and end in absolute indices
+    std::pair<std::pair<ptrdiff_t, ptrdiff_t>, std::pair<ptrdiff_t, ptrdiff_t>> middle_snake(ptrdiff_t x0, ptrdiff_t x1,
+                                                                                            ptrdiff_t y0, ptrdiff_t y1)
+    {
+        const auto n = x1 - x0, m = y1 - y0;
+        const auto delta = n - m;
+        const auto odd = (delta & 1) != 0;
+        const auto mid = static_cast<ptrdiff_t>(forward.size() / 2);
+        auto* fv = forward.data() + mid;  // fv[k]: furthest x on diagonal k = x - y from the start
+        auto* bv = backward.data() + mid;  // bv[k]: furthest x on diagonal k from the end (reversed)
+        fv[1] = 0;
+        bv[1] = 0;
+        for (ptrdiff_t d = 0;; ++d) {
+            for (auto k = -d; k <= d; k += 2) {
+                auto x = (k == -d || (k != d && fv[k - 1] < fv[k + 1])) ? fv[k + 1] : fv[k - 1] + 1;
+                auto y = x - k;
+                const auto sx = x, sy = y;
+                while (x < n && y < m && a[x0 + x] == b[y0 + y])
+                    ++x, ++y;
+                fv[k] = x;
+                if (odd && delta - k >= -(d - 1) && delta - k <= d - 1 && fv[k] + bv[delta - k] >= n)
+                    return {{x0 + sx, y0 + sy}, {x0 + x, y0 + y}};
+            }
+            for (auto k = -d; k <= d; k += 2) {
+                auto x = (k == -d || (k != d && bv[k - 1] < bv[k + 1])) ? bv[k + 1] : bv[k - 1] + 1;
+                auto y = x - k;
+                const auto sx = x, sy = y;
+                while (x < n && y < m && a[x1 - 1 - x] == b[y1 - 1 - y])
+                    ++x, ++y;
+                bv[k] = x;
+                if (!odd && delta - k >= -d && delta - k <= d && bv[k] + fv[delta - k] >= n)
+                    return {{x1 - x, y1 - y}, {x1 - sx, y1 - sy}};
+            }
+        }
+    }
+
+    void match(ptrdiff_t x0, ptrdiff_t x1, ptrdiff_t y0, ptrdiff_t y1)
+    {
+        // Common prefix and suffix need no search.
+        while (x0 < x1 && y0 < y1 && a[x0] == b[y0])
+            matches.emplace_back(x0++, y0++);
+        auto suffix = ptrdiff_t{0};
+        while (x0 < x1 - suffix && y0 < y1 - suffix && a[x1 - 1 - suffix] == b[y1 - 1 - suffix])
+            ++suffix;
+        if (x0 < x1 - suffix && y0 < y1 - suffix) {
+            const auto [start, end] = middle_snake(x0, x1 - suffix, y0, y1 - suffix);
+            match(x0, start.first, y0, start.second);
+            for (auto x = start.first, y = start.second; x < end.first; ++x, ++y)
+                matches.emplace_back(x, y);
+            match(end.first, x1 - suffix, end.second, y1 - suffix);
+        }
+        for (auto i = suffix; i > 0; --i)
+            matches.emplace_back(x1 - i, y1 - i);
+    }
+};
+}  // namespace
+
+std::vector<std::pair<size_t, size_t>> match_sequences(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+    auto res = std::vector<std::pair<size_t, size_t>>{};
+    const auto size = a.size() + b.size() + 2;
+    auto m = myers_t{a.data(), b.data(), std::vector<ptrdiff_t>(2 * size + 1), std::vector<ptrdiff_t>(2 * size + 1),
+                     res};
+    m.match(0, a.size(), 0, b.size());
+    return res;
+}
+
+namespace {
+void print_bound(std::ostream& os, const bound_t& bound)
+{
+    if (bound.value == infinity.value)
+        os << "<inf";
+    else
+        os << (bound.strict ? "<" : "<=") << bound.value;
+}
+
+/** Prints the locations, integers and bounds which differ between the states.
+ * @returns true if the states differ. */
+bool print_state_diff(const model_t& model, const State& a, const State& b, std::ostream& os)
+{
+    auto differ = false;
+    for (size_t p = 0; p < model.processes.size(); ++p) {
+        if (a.locations[p] != b.locations[p]) {
+            const auto& proc = model.processes[p];
+            os << "    " << proc.name << ": " << model.layout[proc.locations[a.locations[p]]].name << " | "
+               << model.layout[proc.locations[b.locations[p]]].name << '\n';
+            differ = true;
+        }
+    }
+    for (size_t v = 0; v < model.integers.size(); ++v) {
+        if (a.integers[v] != b.integers[v]) {
+            os << "    " << model.integers[v] << ": " << a.integers[v] << " | " << b.integers[v] << '\n';
+            differ = true;
+        }
+    }
+    const auto clock_count = model.clocks.size();
+    for (size_t i = 0; i < clock_count; ++i) {
+        for (size_t j = 0; j < clock_count; ++j) {
+            const auto& ba = a.get_bound(clock_count, i, j);
+            const auto& bb = b.get_bound(clock_count, i, j);
+            if (ba.value != bb.value || ba.strict != bb.strict) {
+                os << "    " << model.clocks[i] << '-' << model.clocks[j] << ": ";
+                print_bound(os, ba);
+                os << " | ";
+                print_bound(os, bb);
+                os << '\n';
+                differ = true;
+            }
+        }
+    }
+    return differ;
+}
+
+/** Reads the trace interning its states and transitions into the store. */
+void read_trace(const model_t& model, std::istream& is, shared_state_store_t& store, state_id_t& initial,
+                step_list_t& steps)
+{
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    initial = store.intern(step.state);
+    while (reader.next(step))
+        steps.push_back(store.intern(step));
+}
+}  // namespace
+
+diff_stats_t diff_traces(const model_t& model, std::istream& a, std::istream& b, std::ostream& os, size_t max_memory)
+{
+    // Both traces share the store, so equal transitions and states get equal IDs.
+    // The traces are parsed in parallel as parsing dominates the running time.
+    auto store = std::make_unique<shared_state_store_t>();
+    auto initial_a = state_id_t{}, initial_b = state_id_t{};
+    const auto budget = max_memory == step_list_t::unlimited ? max_memory : max_memory / 2;
+    auto steps_a = step_list_t{budget}, steps_b = step_list_t{budget};
+    auto reading_b = std::async(std::launch::async, [&] { read_trace(model, b, *store, initial_b, steps_b); });
+    read_trace(model, a, *store, initial_a, steps_a);
+    reading_b.get();
+    auto transitions = [](const step_list_t& steps) {
+        auto res = std::vector<uint32_t>(steps.size());
+        for (auto i = size_t{0}; i < steps.size(); ++i)
+            res[i] = steps[i].transition;
+        return res;
+    };
+    const auto matches = match_sequences(transitions(steps_a), transitions(steps_b));
+
+    auto res = diff_stats_t{steps_a.size(), steps_b.size(), matches.size()};
+    auto state_a = State{}, state_b = State{};
+    auto transition = Transition{};
+    auto compare = [&](state_id_t ida, state_id_t idb, size_t i, size_t j) {
+        if (ida == idb)
+            return;
+        store->load(ida, state_a);
+        store->load(idb, state_b);
+        if (i == 0) {
+            os << "= initial state\n";
+        } else {
+            store->load(steps_a[i - 1].transition, transition);
+            transition.print(model, os << "= " << i << ' ' << j << ' ') << '\n';
+        }
+        print_state_diff(model, state_a, state_b, os);
+        ++res.differing;
+    };
+    compare(initial_a, initial_b, 0, 0);
+    auto i = size_t{0}, j = size_t{0};  // steps aligned so far
+    auto report = [&](size_t to_i, size_t to_j) {
+        for (; i < to_i; ++i, ++res.only_a) {
+            store->load(steps_a[i].transition, transition);
+            transition.print(model, os << "- " << i + 1 << ' ') << '\n';
+        }
+        for (; j < to_j; ++j, ++res.only_b) {
+            store->load(steps_b[j].transition, transition);
+            transition.print(model, os << "+ " << j + 1 << ' ') << '\n';
+        }
+    };
+    for (const auto& [mi, mj] : matches) {
+        report(mi, mj);
+        compare(steps_a[mi].state, steps_b[mj].state, mi + 1, mj + 1);
+        i = mi + 1;
+        j = mj + 1;
+    }
+    report(steps_a.size(), steps_b.size());
+    return res;
+}
@@ -0,0 +1,55 @@
+#ifndef TRACER_DIFF_HPP
+#define TRACER_DIFF_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+
+#include "tracer.hpp"
+
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/** Aligns two sequences: finds a longest common subsequence by Myers' O((N+M)D) algorithm
+ * in linear space (divide and conquer on the middle snake).
+ * @returns the index pairs of the matched elements in increasing order. */
+std::vector<std::pair<size_t, size_t>> match_sequences(const std::vector<uint32_t>& a,
+                                                       const std::vector<uint32_t>& b);
+
+/** Summary of the differences between two traces. */
+struct diff_stats_t
+{
+    size_t steps_a{0};    ///< number of steps in the first trace
+    size_t steps_b{0};    ///< number of steps in the second trace
+    size_t matched{0};    ///< steps aligned by equal transitions
+    size_t differing{0};  ///< aligned steps (and initial states) reaching different states
+    size_t only_a{0};     ///< steps only in the first trace
+    size_t only_b{0};     ///< steps only in the second trace
+    bool equal() const { return differing == 0 && only_a == 0 && only_b == 0; }
+};
+
+/** Compares two traces over the same model: the steps are aligned by their transitions and
+ * the differences are reported as unmatched steps and as differing locations, integers and bounds of aligned steps.
+ * The stored steps beyond max_memory bytes (shared by the two traces) are spilled to disk. */
+diff_stats_t diff_traces(const model_t&, std::istream& a, std::istream& b, std::ostream& os,
+                         size_t max_memory = step_list_t::unlimited);
+
+#endif  // TRACER_DIFF_HPP
@@ -0,0 +1,227 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "gather.hpp"
+
+#include <charconv>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+fragments_t::fragments_t(const model_t& model):
+    model{model}, edges(model.edges.size()), labels(model.edges.size())
+{
+    locations.resize(model.processes.size());
+    for (size_t p = 0; p < model.processes.size(); ++p)
+        for (auto idx : model.processes[p].locations)
+            locations[p].push_back(model.processes[p].name + '.' + model.layout[idx].name + ' ');
+    for (const auto& name : model.integers)
+        integers.push_back(name + '=');
+    for (const auto& x : model.clocks) {
+        for (const auto& y : model.clocks) {
+            differences.push_back(x + '-' + y + "<=");
+            differences.push_back(x + '-' + y + '<');
+        }
+        clocks.push_back(x + "=[");
+        clocks.push_back(x + "=(");
+    }
+}
+
+void fragments_t::format_edge(int eid) const
+{
+    const auto& e = model.edges[eid];
+    const auto& name = model.processes[e.process].name;
+    labels[eid] = " {" + model.expressions.at(e.guard) + "; " + model.expressions.at(e.sync) + "; " +
+                  model.expressions.at(e.update) + ";} ";
+    edges[eid] = name + '.' + model.layout[e.source].name + " -> " + name + '.' + model.layout[e.target].name;
+}
+
+gather_writer_t::gather_writer_t(int fd): fd{fd}, arena(1u << 16)
+{
+    buffers.reserve(max_buffers);
+}
+
+gather_writer_t::~gather_writer_t() { flush(); }
+
+char* gather_writer_t::reserve(size_t n)
+{
+    if (used + n > arena.size() || buffers.size() + 1 >= max_buffers)
+        flush();
+    return arena.data() + used;
+}
+
+void gather_writer_t::commit(const char* p, size_t n)
+{
+    // Extend the last buffer if it ends in the arena where the text was copied.
+    if (!buffers.empty() && static_cast<const char*>(buffers.back().iov_base) + buffers.back().iov_len == p)
+        buffers.back().iov_len += n;
+    else
+        buffers.push_back({const_cast<char*>(p), n});
+    used += n;
+}
+
+void gather_writer_t::constant(const char* text, size_t size)
+{
+    if (size < min_reference) {
+        copy(text, size);
+    } else {
+        if (buffers.size() + 1 >= max_buffers)
+            flush();
+        buffers.push_back({const_cast<char*>(text), size});
+    }
+}
+
+void gather_writer_t::copy(const char* text, size_t size)
+{
+    if (size > arena.size()) {
+        flush();
+        buffers.push_back({const_cast<char*>(text), size});
+        flush();
+        return;
+    }
+    auto* p = reserve(size);
+    std::memcpy(p, text, size);
+    commit(p, size);
+}
+
+void gather_writer_t::number(int value)
+{
+    constexpr auto digits = 12;  // sign and 10 digits of a 32-bit integer
+    auto* p = reserve(digits);
+    commit(p, std::to_chars(p, p + digits, value).ptr - p);
+}
+
+bool gather_writer_t::flush()
+{
+    auto* next = buffers.data();
+    auto* end = next + buffers.size();
+    while (next != end && !failed) {
+#ifdef _WIN32
+        const auto written = ::_write(fd, next->iov_base, static_cast<unsigned>(next->iov_len));
+#else
+        const auto written = ::writev(fd, next, static_cast<int>(end - next));
+#endif
+        if (written < 0) {
+            if (errno != EINTR)
+                failed = true;  // e.g. EPIPE from a closed pager
+            continue;
+        }
+        // Skip the buffers written, a partial write leaves the rest of the last one.
+        auto rest = static_cast<size_t>(written);
+        for (; next != end && rest >= next->iov_len; ++next)
+            rest -= next->iov_len;
+        if (rest > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + rest;
+            next->iov_len -= rest;
+        }
+    }
+    buffers.clear();
+    used = 0;
+    return !failed;
+}
+
+gather_printer_t::gather_printer_t(const model_t& model, int fd, const state_view_t& view):
+    model{model}, view{view}, fragments{model}, writer{fd}
+{}
+
+void gather_printer_t::print(const State& s)
+{
+    for (size_t p = 0; p < model.processes.size(); ++p)
+        if (view.processes.empty() || view.processes[p])
+            writer.constant(fragments.location(p, s.locations[p]));
+    for (size_t v = 0; v < model.integers.size(); ++v) {
+        if (view.integers.empty() || view.integers[v]) {
+            writer.constant(fragments.integer(v));
+            writer.number(s.integers[v]);
+            writer.copy(' ');
+        }
+    }
+    const auto clock_count = model.clocks.size();
+    // As in State::print: the reference clock #t(0) stays since it carries the bounds of the other clocks.
+    auto hidden = [&](size_t c) { return !view.internal_clocks && c != 0 && model.clocks[c][0] == '#'; };
+    if (view.intervals) {
+        s.clock_bounds(clock_count, lower, upper);
+        for (size_t c = 1; c < clock_count; ++c) {
+            if (hidden(c))
+                continue;
+            writer.constant(fragments.clock(c, lower[c].strict));
+            writer.number(-lower[c].value);
+            writer.copy(',');
+            if (upper[c].value == infinity.value) {
+                writer.copy("inf) ", 5);
+            } else {
+                writer.number(upper[c].value);
+                writer.copy(upper[c].strict ? ") " : "] ", 2);
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < clock_count; ++i) {
+        for (size_t j = 0; j < clock_count; ++j) {
+            if (i != j && !hidden(i) && !hidden(j)) {
+                const auto& bnd = s.get_bound(clock_count, i, j);
+                if (bnd.value != infinity.value) {
+                    writer.constant(fragments.difference(i, j, bnd.strict));
+                    writer.number(bnd.value);
+                    writer.copy(' ');
+                }
+            }
+        }
+    }
+}
+
+void gather_printer_t::print(const Transition& t)
+{
+    for (const auto& edge : t.edges) {
+        const auto eid = model.processes[edge.process].edges[edge.edge];
+        writer.constant(fragments.edge(eid));
+        if (!edge.select.empty()) {
+            writer.copy(" [", 2);
+            for (auto s = edge.select.begin(); s != edge.select.end(); ++s) {
+                if (s != edge.select.begin())
+                    writer.copy(',');
+                writer.number(*s);
+            }
+            writer.copy(']');
+        }
+        writer.constant(fragments.label(eid));
+    }
+}
+
+void gather_printer_t::initial(const State& state)
+{
+    writer.copy("State: ", 7);
+    print(state);
+    writer.copy('\n');
+}
+
+void gather_printer_t::step(const Successor& step)
+{
+    writer.copy("\nTransition: ", 13);
+    print(step.transition);
+    writer.copy("\n\nState: ", 9);
+    print(step.state);
+    writer.copy('\n');
+}
@@ -0,0 +1,131 @@
+#ifndef TRACER_GATHER_HPP
+#define TRACER_GATHER_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "tracer.hpp"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#ifdef _WIN32
+struct iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+/** The model-constant text printed by State::print and Transition::print, formatted once per model. */
+class fragments_t
+{
+    const model_t& model;
+    std::vector<std::vector<std::string>> locations;  ///< "Proc.Loc " per process and location
+    std::vector<std::string> integers;                ///< "name=" per integer
+    std::vector<std::string> differences;             ///< "x-y<=" and "x-y<" per clock pair (i*n+j)*2+strict
+    std::vector<std::string> clocks;                  ///< "x=[" and "x=(" per clock c*2+strict
+    mutable std::vector<std::string> edges;           ///< "Proc.Src -> Proc.Dst" per edge, formatted on first use
+    mutable std::vector<std::string> labels;          ///< " {guard; sync; update;} " per edge
+
+    void format_edge(int eid) const;
+
+public:
+    explicit fragments_t(const model_t&);
+    const std::string& location(size_t process, int location) const { return locations[process][location]; }
+    const std::string& integer(size_t v) const { return integers[v]; }
+    const std::string& difference(size_t i, size_t j, bool strict) const
+    {
+        return differences[(i * model.clocks.size() + j) * 2 + strict];
+    }
+    const std::string& clock(size_t c, bool strict) const { return clocks[c * 2 + strict]; }
+    /// The source and target of the edge
+    const std::string& edge(int eid) const
+    {
+        if (edges[eid].empty())
+            format_edge(eid);
+        return edges[eid];
+    }
+    /// The guard, synchronisation and update of the edge (after edge())
+    const std::string& label(int eid) const { return labels[eid]; }
+};
+
+/** Writes text to a file descriptor as a list of buffers gathered with writev:
+ * long constant text is referenced in place and must stay unchanged until flushed,
+ * short text and formatted numbers are copied into an internal buffer. */
+class gather_writer_t
+{
+    static constexpr size_t max_buffers = 1024;  ///< the minimum IOV_MAX allowed by POSIX
+    static constexpr size_t min_reference = 48;  ///< shorter text is copied, which is cheaper than another buffer
+    int fd;
+    std::vector<iovec> buffers;
+    std::vector<char> arena;  ///< copied text, never reallocated
+    size_t used{0};           ///< bytes of the arena in use
+    bool failed{false};
+
+    /// Makes room for n bytes in the arena, flushing if needed
+    char* reserve(size_t n);
+    /// Adds the n bytes written at p = reserve(n)
+    void commit(const char* p, size_t n);
+
+public:
+    explicit gather_writer_t(int fd);
+    gather_writer_t(const gather_writer_t&) = delete;
+    gather_writer_t& operator=(const gather_writer_t&) = delete;
+    ~gather_writer_t();
+    /// Text that stays unchanged until the next flush
+    void constant(const char* text, size_t size);
+    void constant(const std::string& text) { constant(text.data(), text.size()); }
+    /// Text that is copied
+    void copy(const char* text, size_t size);
+    void copy(char c) { copy(&c, 1); }
+    void number(int value);
+    /// Writes the gathered text, returns false if the output has failed (e.g. closed)
+    bool flush();
+    bool good() const { return !failed; }
+};
+
+/** Prints states and transitions in the text format of State::print and Transition::print,
+ * gathering the model-constant text from the fragments instead of copying it for every step. */
+class gather_printer_t
+{
+    const model_t& model;
+    const state_view_t& view;
+    fragments_t fragments;
+    gather_writer_t writer;
+    std::vector<bound_t> lower, upper;
+
+    void print(const State&);
+    void print(const Transition&);
+
+public:
+    /// Prints to the file descriptor, the view must outlive the printer
+    gather_printer_t(const model_t&, int fd, const state_view_t& view);
+    /// Prints the initial state: "State: " followed by the state and a newline
+    void initial(const State&);
+    /// Prints the successor like Successor::print
+    void step(const Successor&);
+    bool flush() { return writer.flush(); }
+    bool good() const { return writer.good(); }
+};
+
+#endif  // TRACER_GATHER_HPP
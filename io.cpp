@@ -0,0 +1,718 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "io.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef TRACER_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TRACER_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+input_buffer_t::input_buffer_t(std::FILE* file, closer_t closer, size_t size):
+    file{file}, closer{closer}, buffer(size)
+{
+    assert(file != nullptr);
+    assert(size > 0);
+    std::setvbuf(file, nullptr, _IONBF, 0);  // we do our own buffering
+    set_window(buffer.data(), buffer.data());
+}
+
+int input_buffer_t::close()
+{
+    auto res = 0;
+    if (file != nullptr && closer != nullptr)
+        res = closer(file);
+    file = nullptr;
+    set_window(buffer.data(), buffer.data());
+    return res;
+}
+
+input_buffer_t::int_type input_buffer_t::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    if (file == nullptr)
+        return traits_type::eof();
+#ifdef _WIN32
+    const auto count = std::fread(buffer.data(), 1, buffer.size(), file);
+#else
+    // A single read returns what is available, so that the steps arriving through a pipe are processed
+    // as soon as they arrive instead of when the buffer is full (the FILE is unbuffered).
+    if (waiting) {
+        auto ready = pollfd{fileno(file), POLLIN, 0};
+        if (poll(&ready, 1, 0) == 0)
+            waiting();
+    }
+    auto count = ::read(fileno(file), buffer.data(), buffer.size());
+    while (count < 0 && errno == EINTR)
+        count = ::read(fileno(file), buffer.data(), buffer.size());
+#endif
+    if (count <= 0)
+        return traits_type::eof();
+    set_window(buffer.data(), buffer.data() + count);
+    return traits_type::to_int_type(*gptr());
+}
+
+input_buffer_t::pos_type input_buffer_t::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    if (file == nullptr || (which & std::ios_base::in) == 0 || pos < 0)
+        return pos_type(off_type(-1));
+#ifdef _WIN32
+    const auto failed = _fseeki64(file, pos, SEEK_SET) != 0;
+#else
+    const auto failed = fseeko(file, pos, SEEK_SET) != 0;
+#endif
+    if (failed)
+        return pos_type(off_type(-1));
+    set_window(buffer.data(), buffer.data(), pos);
+    return pos;
+}
+
+#ifdef _WIN32
+
+mapped_file_t::mapped_file_t(const std::string& path)
+{
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        throw std::system_error{errno, std::generic_category(), path};
+    char chunk[1u << 16];
+    while (auto count = std::fread(chunk, 1, sizeof(chunk), file))
+        copy.insert(copy.end(), chunk, chunk + count);
+    std::fclose(file);
+    data = copy.data();
+    length = copy.size();
+}
+
+mapped_file_t::~mapped_file_t() = default;
+
+#else
+
+mapped_file_t::mapped_file_t(const std::string& path)
+{
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw std::system_error{errno, std::generic_category(), path};
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        const auto error = errno;
+        ::close(fd);
+        throw std::system_error{error, std::generic_category(), path};
+    }
+    length = info.st_size;
+    if (length > 0) {
+        auto* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            const auto error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), path};
+        }
+        data = static_cast<const char*>(addr);
+    } else {
+        data = copy.data();
+    }
+    ::close(fd);  // the mapping stays valid
+}
+
+mapped_file_t::~mapped_file_t()
+{
+    if (length > 0)
+        munmap(const_cast<char*>(data), length);
+}
+
+#endif
+
+compression_t detect_compression(const char* data, size_t size)
+{
+    if (size >= 2 && data[0] == '\x1f' && data[1] == '\x8b')
+        return compression_t::gzip;
+    if (size >= 4 && std::memcmp(data, "\x28\xb5\x2f\xfd", 4) == 0)
+        return compression_t::zstd;
+    return compression_t::none;
+}
+
+/** Input stream buffer decompressing the source on its own thread: the decompressed data is passed
+ * in chunks through a short queue, so that decompression runs ahead of and in parallel with the parsing. */
+class decompress_buffer_t : public window_buffer_t
+{
+    static constexpr size_t chunk_size = 1u << 20;
+    static constexpr size_t queue_size = 4;
+    std::unique_ptr<input_buffer_t> source;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> ready;  ///< decompressed chunks in order
+    std::vector<std::vector<char>> spare;  ///< consumed chunks for reuse
+    std::vector<char> current;             ///< the chunk being read
+    bool finished{false};                  ///< the decompressor has stopped
+    bool cancelled{false};                 ///< the reader has stopped
+    std::exception_ptr error;
+#ifndef _WIN32
+    int wake[2] = {-1, -1};  ///< pipe becoming readable once cancelled, to interrupt the wait for the source
+#endif
+    std::thread worker;
+
+    /// Passes the filled chunk to the reader and returns an empty one, blocks while the queue is full.
+    /// @returns false if the reader has stopped
+    bool publish(std::vector<char>& chunk)
+    {
+        auto lock = std::unique_lock{mutex};
+        changed.wait(lock, [this] { return ready.size() < queue_size || cancelled; });
+        if (cancelled)
+            return false;
+        ready.push_back(std::move(chunk));
+        if (spare.empty()) {
+            chunk = std::vector<char>{};
+        } else {
+            chunk = std::move(spare.back());
+            spare.pop_back();
+        }
+        chunk.resize(chunk_size);
+        changed.notify_all();
+        return true;
+    }
+    /// True if reading the source would wait for input that has not arrived yet
+    bool stalled()
+    {
+#ifndef _WIN32
+        if (source->in_avail() <= 0) {
+            auto ready = pollfd{source->descriptor(), POLLIN, 0};
+            return poll(&ready, 1, 0) == 0;
+        }
+#endif
+        return false;
+    }
+    /// Reads the compressed input available (at least one byte), returns 0 at the end or once cancelled
+    size_t read(char* data, size_t size)
+    {
+#ifndef _WIN32
+        // Waits for the source together with the cancellation: a stalled producer must not hold up the destructor.
+        if (source->in_avail() <= 0) {
+            pollfd ready[] = {{source->descriptor(), POLLIN, 0}, {wake[0], POLLIN, 0}};
+            while (poll(ready, 2, -1) < 0)
+                if (errno != EINTR)
+                    throw std::system_error{errno, std::generic_category(), "poll"};
+            if (ready[1].revents != 0)
+                return 0;
+        }
+#endif
+        const auto window = source->window();
+        const auto count = std::min(size, static_cast<size_t>(window.end - window.begin));
+        std::memcpy(data, window.begin, count);
+        source->consume(count);
+        return count;
+    }
+
+    void decompress_gzip();
+    void decompress_zstd();
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        auto lock = std::unique_lock{mutex};
+        if (!current.empty())
+            spare.push_back(std::move(current));
+        changed.notify_all();
+        changed.wait(lock, [this] { return !ready.empty() || finished; });
+        if (ready.empty()) {
+            if (error)
+                std::rethrow_exception(error);
+            return traits_type::eof();
+        }
+        current = std::move(ready.front());
+        ready.pop_front();
+        changed.notify_all();
+        set_window(current.data(), current.data() + current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    decompress_buffer_t(std::unique_ptr<input_buffer_t> input, compression_t format): source{std::move(input)}
+    {
+#ifndef _WIN32
+        if (pipe(wake) != 0)
+            throw std::system_error{errno, std::generic_category(), "pipe"};
+#endif
+        worker = std::thread{[this, format] {
+            try {
+                if (format == compression_t::gzip)
+                    decompress_gzip();
+                else
+                    decompress_zstd();
+            } catch (...) {
+                auto lock = std::lock_guard{mutex};
+                error = std::current_exception();
+            }
+            auto lock = std::lock_guard{mutex};
+            finished = true;
+            changed.notify_all();
+        }};
+    }
+    decompress_buffer_t(const decompress_buffer_t&) = delete;
+    decompress_buffer_t& operator=(const decompress_buffer_t&) = delete;
+    ~decompress_buffer_t() override
+    {
+        {
+            auto lock = std::lock_guard{mutex};
+            cancelled = true;
+            changed.notify_all();
+        }
+#ifndef _WIN32
+        ::close(wake[1]);  // the worker waiting for the source sees the end of the pipe
+#endif
+        worker.join();
+#ifndef _WIN32
+        ::close(wake[0]);
+#endif
+    }
+};
+
+#ifdef TRACER_ZLIB
+void decompress_buffer_t::decompress_gzip()
+{
+    auto stream = z_stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)  // detect the gzip header
+        throw std::runtime_error{"failed to initialize zlib"};
+    auto input = std::vector<char>(chunk_size);
+    auto output = std::vector<char>(chunk_size);
+    auto complete = true;   // no member is partially decoded
+    auto used = size_t{0};  // bytes of the output chunk filled
+    try {
+        while (true) {
+            if (stream.avail_in == 0) {
+                if (used > 0 && stalled()) {  // pass on the data decoded so far before waiting for more input
+                    output.resize(used);
+                    if (!publish(output))
+                        break;
+                    used = 0;
+                }
+                stream.avail_in = read(input.data(), input.size());
+                stream.next_in = reinterpret_cast<Bytef*>(input.data());
+                if (stream.avail_in == 0)
+                    break;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(output.data() + used);
+            stream.avail_out = output.size() - used;
+            const auto status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+                throw std::runtime_error{std::string{"gzip: "} + (stream.msg ? stream.msg : "corrupt data")};
+            used = output.size() - stream.avail_out;
+            complete = status == Z_STREAM_END;
+            if (complete)
+                inflateReset(&stream);  // concatenated gzip members may follow
+            if (used == output.size()) {
+                if (!publish(output))
+                    break;
+                used = 0;
+            }
+        }
+        if (!complete)
+            throw std::runtime_error{"gzip: unexpected end of data"};
+        output.resize(used);
+        if (used > 0)
+            publish(output);
+    } catch (...) {
+        inflateEnd(&stream);
+        throw;
+    }
+    inflateEnd(&stream);
+}
+#else
+void decompress_buffer_t::decompress_gzip() { throw std::runtime_error{"gzip input is not supported: built without zlib"}; }
+#endif
+
+#ifdef TRACER_ZSTD
+void decompress_buffer_t::decompress_zstd()
+{
+    auto context = std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)>{ZSTD_createDCtx(), &ZSTD_freeDCtx};
+    if (!context)
+        throw std::runtime_error{"failed to initialize zstd"};
+    auto input = std::vector<char>(ZSTD_DStreamInSize());
+    auto output = std::vector<char>(chunk_size);
+    auto in = ZSTD_inBuffer{input.data(), 0, 0};
+    auto out = ZSTD_outBuffer{output.data(), output.size(), 0};
+    auto pending = size_t{0};  // non-zero while a frame is incomplete
+    while (true) {
+        if (in.pos == in.size) {
+            if (out.pos > 0 && stalled()) {  // pass on the data decoded so far before waiting for more input
+                output.resize(out.pos);
+                if (!publish(output))
+                    return;
+                out = ZSTD_outBuffer{output.data(), output.size(), 0};
+            }
+            in.size = read(input.data(), input.size());
+            in.pos = 0;
+            if (in.size == 0)
+                break;
+        }
+        pending = ZSTD_decompressStream(context.get(), &out, &in);
+        if (ZSTD_isError(pending))
+            throw std::runtime_error{std::string{"zstd: "} + ZSTD_getErrorName(pending)};
+        if (out.pos == out.size) {
+            if (!publish(output))
+                return;
+            out = ZSTD_outBuffer{output.data(), output.size(), 0};
+        }
+    }
+    // Flush the data decoded from the last input.
+    while (pending != 0 && out.pos < out.size) {
+        const auto before = out.pos;
+        pending = ZSTD_decompressStream(context.get(), &out, &in);
+        if (ZSTD_isError(pending))
+            throw std::runtime_error{std::string{"zstd: "} + ZSTD_getErrorName(pending)};
+        if (out.pos == before)
+            throw std::runtime_error{"zstd: unexpected end of data"};
+        if (out.pos == out.size) {
+            if (!publish(output))
+                return;
+            out = ZSTD_outBuffer{output.data(), output.size(), 0};
+        }
+    }
+    output.resize(out.pos);
+    if (!output.empty())
+        publish(output);
+}
+#else
+void decompress_buffer_t::decompress_zstd() { throw std::runtime_error{"zstd input is not supported: built without libzstd"}; }
+#endif
+
+/** Returns true if the compression format can be decompressed in-process. */
+static bool supported(compression_t format)
+{
+#ifdef TRACER_ZLIB
+    if (format == compression_t::gzip)
+        return true;
+#endif
+#ifdef TRACER_ZSTD
+    if (format == compression_t::zstd)
+        return true;
+#endif
+    return false;
+}
+
+/// Wraps the compressed source into a stream which rethrows decompression errors (instead of only setting badbit)
+static std::unique_ptr<std::istream> decompressed(std::unique_ptr<input_buffer_t> source, compression_t format)
+{
+    auto res = std::make_unique<input_stream_t>(std::make_unique<decompress_buffer_t>(std::move(source), format));
+    res->exceptions(std::ios::badbit);
+    return res;
+}
+
+static std::FILE* start(const std::string& command);
+
+std::unique_ptr<std::istream> open_input(const std::string& path)
+{
+    if (path == "-") {
+        auto buffer = std::make_unique<input_buffer_t>(stdin, nullptr);
+        const auto window = buffer->window();
+        const auto format = detect_compression(window.begin, window.end - window.begin);
+        if (format == compression_t::none)
+            return std::make_unique<input_stream_t>(std::move(buffer));
+        return decompressed(std::move(buffer), format);
+    }
+    auto* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return nullptr;
+    char magic[4];
+    const auto format = detect_compression(magic, std::fread(magic, 1, sizeof(magic), file));
+    if (format == compression_t::none) {
+#ifdef _WIN32
+        file = std::freopen(path.c_str(), "r", file);  // text mode
+        if (file == nullptr)
+            return nullptr;
+#else
+        std::rewind(file);
+#endif
+        return std::make_unique<input_stream_t>(std::make_unique<input_buffer_t>(file));
+    }
+    std::rewind(file);
+    if (supported(format))
+        return decompressed(std::make_unique<input_buffer_t>(file), format);
+    // Fall back to the command line decompressor running as a separate process.
+    std::fclose(file);
+    const auto* tool = format == compression_t::gzip ? "gzip" : "zstd";
+    auto* pipe = start(std::string{tool} + " -dc " + shell_quote(path));
+    return std::make_unique<input_stream_t>(std::make_unique<input_buffer_t>(pipe, &pclose));
+}
+
+void write_u32(std::ostream& os, uint32_t value)
+{
+    const char bytes[] = {char(value), char(value >> 8), char(value >> 16), char(value >> 24)};
+    os.write(bytes, sizeof(bytes));
+}
+
+void write_u64(std::ostream& os, uint64_t value)
+{
+    write_u32(os, static_cast<uint32_t>(value));
+    write_u32(os, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t read_u32(std::istream& is)
+{
+    unsigned char bytes[4];
+    if (!is.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+        throw std::runtime_error{"unexpected end of binary input"};
+    return bytes[0] | uint32_t{bytes[1]} << 8 | uint32_t{bytes[2]} << 16 | uint32_t{bytes[3]} << 24;
+}
+
+uint64_t read_u64(std::istream& is)
+{
+    const auto low = read_u32(is);
+    return low | uint64_t{read_u32(is)} << 32;
+}
+
+std::string shell_quote(const std::string& arg)
+{
+#ifdef _WIN32
+    auto res = std::string{"\""};
+    for (auto c : arg) {
+        if (c == '"')
+            res += '\\';
+        res += c;
+    }
+    return res += '"';
+#else
+    auto res = std::string{"'"};
+    for (auto c : arg) {
+        if (c == '\'')
+            res += "'\\''";
+        else
+            res += c;
+    }
+    return res += '\'';
+#endif
+}
+
+/** Converts the result of pclose into the process exit code. */
+static int exit_status(int status)
+{
+#ifdef _WIN32
+    return status;
+#else
+    if (status == -1)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#endif
+}
+
+/** Output of a subprocess read through a pipe. */
+class pipe_stream_t : public process_stream_t
+{
+    input_buffer_t buffer;
+
+public:
+    explicit pipe_stream_t(std::FILE* pipe): process_stream_t{nullptr}, buffer{pipe, &pclose} { rdbuf(&buffer); }
+    int wait() override { return exit_status(buffer.close()); }
+};
+
+/** Starts the shell command reading its standard output. Throws upon failure. */
+static std::FILE* start(const std::string& command)
+{
+    std::cout.flush();  // the child inherits the output buffers
+    std::cerr.flush();
+    auto* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr)
+        throw std::system_error{errno, std::generic_category(), command};
+    return pipe;
+}
+
+std::unique_ptr<process_stream_t> checker_t::compile(const std::string& model) const
+{
+#ifdef _WIN32
+    _putenv_s("UPPAAL_COMPILE_ONLY", "1");
+    auto* pipe = start(shell_quote(path) + " " + shell_quote(model));
+    _putenv_s("UPPAAL_COMPILE_ONLY", "");
+#else
+    auto* pipe = start("UPPAAL_COMPILE_ONLY=1 " + shell_quote(path) + " " + shell_quote(model));
+#endif
+    return std::make_unique<pipe_stream_t>(pipe);
+}
+
+/** Copies the checker output to the standard error until the checker terminates. Returns the exit status. */
+static int forward_output(std::FILE* pipe)
+{
+    char line[1024];
+    while (std::fgets(line, sizeof(line), pipe) != nullptr)
+        std::fputs(line, stderr);
+    return exit_status(pclose(pipe));
+}
+
+#ifdef _WIN32
+
+/** Trace file written by a checker which has already terminated. */
+class trace_file_stream_t : public process_stream_t
+{
+    std::filesystem::path dir;
+    std::unique_ptr<input_buffer_t> buffer;
+    int status;
+
+public:
+    trace_file_stream_t(std::filesystem::path dir, const std::filesystem::path& trace, int status):
+        process_stream_t{nullptr}, dir{std::move(dir)}, status{status}
+    {
+        if (auto* file = std::fopen(trace.string().c_str(), "r"); file != nullptr) {
+            buffer = std::make_unique<input_buffer_t>(file);
+            rdbuf(buffer.get());
+        } else {
+            setstate(std::ios::eofbit);
+        }
+    }
+    ~trace_file_stream_t() override
+    {
+        buffer.reset();
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(dir, ec);
+    }
+    int wait() override { return status; }
+};
+
+std::unique_ptr<process_stream_t> checker_t::verify(const std::string& model, const std::string& query) const
+{
+    // Windows has no FIFOs: let the checker finish and then read the trace file.
+    auto dir = std::filesystem::temp_directory_path() / ("tracer-" + std::to_string(std::rand()));
+    std::filesystem::create_directories(dir);
+    const auto prefix = (dir / "trace").string();
+    auto* pipe = start(shell_quote(path) + " " + options + " -f " + shell_quote(prefix) + " " + shell_quote(model) +
+                       " " + shell_quote(query));
+    const auto status = forward_output(pipe);
+    return std::make_unique<trace_file_stream_t>(dir, prefix + "-1.xtr", status);
+}
+
+#else
+
+/** Trace read from a FIFO while the checker is writing it.
+ * The checker may terminate without ever opening the FIFO (e.g. if there is no trace),
+ * hence the FIFO is opened without blocking and a writer end is kept open until the checker terminates,
+ * so that the reader blocks while the trace is being produced and sees EOF only after the checker is done. */
+class fifo_stream_t : public process_stream_t
+{
+    std::filesystem::path dir;
+    std::unique_ptr<input_buffer_t> buffer;
+    int writer{-1};
+    int status{-1};
+    std::thread forwarder;
+
+public:
+    fifo_stream_t(std::filesystem::path directory, const std::string& command):
+        process_stream_t{nullptr}, dir{std::move(directory)}
+    {
+        const auto fifo = dir / "trace-1.xtr";
+        if (mkfifo(fifo.c_str(), 0600) != 0)
+            throw std::system_error{errno, std::generic_category(), fifo.string()};
+        const auto reader = open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (reader == -1)
+            throw std::system_error{errno, std::generic_category(), fifo.string()};
+        std::FILE* file = nullptr;
+        std::FILE* pipe = nullptr;
+        try {
+            writer = open(fifo.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (writer == -1)
+                throw std::system_error{errno, std::generic_category(), fifo.string()};
+            fcntl(reader, F_SETFL, fcntl(reader, F_GETFL) & ~O_NONBLOCK);
+            file = fdopen(reader, "r");
+            if (file == nullptr)
+                throw std::system_error{errno, std::generic_category(), fifo.string()};
+            buffer = std::make_unique<input_buffer_t>(file);
+            rdbuf(buffer.get());
+            pipe = start(command);
+            forwarder = std::thread{[this, pipe] {
+                status = forward_output(pipe);
+                ::close(writer);  // unblocks the reader once the checker has closed its end too
+            }};
+        } catch (...) {
+            // The destructor does not run: close the FIFO ends before waiting for a started checker, after removing
+            // the FIFO so that the checker cannot block opening it without a reader (it fails to open it instead).
+            auto ec = std::error_code{};
+            std::filesystem::remove(fifo, ec);
+            if (buffer)
+                buffer->close();
+            else if (file != nullptr)
+                std::fclose(file);
+            else
+                ::close(reader);
+            if (writer != -1)
+                ::close(writer);
+            if (pipe != nullptr)
+                pclose(pipe);
+            throw;
+        }
+    }
+    ~fifo_stream_t() override
+    {
+        wait();
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(dir, ec);
+    }
+    int wait() override
+    {
+        // A checker that has not opened the FIFO yet fails to instead of blocking without a reader.
+        auto ec = std::error_code{};
+        std::filesystem::remove(dir / "trace-1.xtr", ec);
+        buffer->close();  // a checker still writing the trace gets a broken pipe instead of blocking
+        if (forwarder.joinable())
+            forwarder.join();
+        return status;
+    }
+};
+
+std::unique_ptr<process_stream_t> checker_t::verify(const std::string& model, const std::string& query) const
+{
+    auto dir = (std::filesystem::temp_directory_path() / "tracer-XXXXXX").string();
+    if (mkdtemp(dir.data()) == nullptr)
+        throw std::system_error{errno, std::generic_category(), dir};
+    const auto prefix = (std::filesystem::path{dir} / "trace").string();
+    try {
+        return std::make_unique<fifo_stream_t>(dir, shell_quote(path) + " " + options + " -f " + shell_quote(prefix) +
+                                                        " " + shell_quote(model) + " " + shell_quote(query));
+    } catch (...) {
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(dir, ec);
+        throw;
+    }
+}
+
+#endif
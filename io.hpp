@@ -0,0 +1,212 @@
+#ifndef TRACER_IO_HPP
+#define TRACER_IO_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+/** Input stream buffer whose buffered input can be parsed in place (see trace_reader_t). */
+class window_buffer_t : public std::streambuf
+{
+    uint64_t fills{0};
+    uint64_t origin{0};  ///< input position of the window begin
+
+protected:
+    /// Sets the buffered input following the previous window, which is no longer valid
+    void set_window(char* begin, char* end) { set_window(begin, end, origin + (egptr() - eback())); }
+    /// Sets the buffered input starting at the input position (e.g. after seeking)
+    void set_window(char* begin, char* end, uint64_t position)
+    {
+        setg(begin, begin, end);
+        origin = position;
+        ++fills;
+    }
+    /// Reports the input position (tellg), other seeks are not supported unless overridden
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        if (off != 0 || dir != std::ios_base::cur || (which & std::ios_base::in) == 0)
+            return pos_type(off_type(-1));
+        return pos_type(off_type(position()));
+    }
+
+public:
+    /// The buffered input not read yet
+    struct window_t
+    {
+        const char* begin;
+        const char* end;
+        uint64_t fill;  ///< changes whenever the buffer is refilled
+    };
+    /// Fills the buffer if it is empty and returns the buffered input without consuming it
+    window_t window()
+    {
+        if (gptr() == egptr())
+            underflow();
+        return {gptr(), egptr(), fills};
+    }
+    /// Consumes the first count bytes of the window
+    void consume(size_t count) { gbump(static_cast<int>(count)); }
+    /// Number of bytes consumed from the input
+    uint64_t position() const { return origin + (gptr() - eback()); }
+};
+
+/** Input stream buffer over a C stream (regular file, stdin, pipe or FIFO).
+ * Reads in large chunks directly into its own buffer, bypassing the C stream buffering. */
+class input_buffer_t : public window_buffer_t
+{
+public:
+    using closer_t = int (*)(std::FILE*);
+
+private:
+    std::FILE* file;
+    closer_t closer;
+    std::vector<char> buffer;
+    std::function<void()> waiting;
+
+protected:
+    int_type underflow() override;
+    /// Seeks regular files to the absolute position (seekg), fails on pipes
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+public:
+    static constexpr size_t default_size = 1u << 20;  ///< 1MiB
+    /// Wraps the file, closes it with closer upon destruction unless closer is nullptr
+    explicit input_buffer_t(std::FILE* file, closer_t closer = &std::fclose, size_t size = default_size);
+    input_buffer_t(const input_buffer_t&) = delete;
+    input_buffer_t& operator=(const input_buffer_t&) = delete;
+    ~input_buffer_t() override { close(); }
+    /// Closes the file, returns the result of closer (e.g. process exit status for pipes)
+    int close();
+    /// Descriptor of the file, -1 once closed
+    int descriptor() const { return file != nullptr ? fileno(file) : -1; }
+    /// Calls back before blocking on input that has not arrived yet (e.g. to flush the output so far)
+    void on_wait(std::function<void()> callback) { waiting = std::move(callback); }
+};
+
+/** Input stream which owns its stream buffer. */
+class input_stream_t : public std::istream
+{
+    std::unique_ptr<std::streambuf> buffer;
+
+public:
+    explicit input_stream_t(std::unique_ptr<std::streambuf> buffer):
+        std::istream{buffer.get()}, buffer{std::move(buffer)}
+    {}
+};
+
+/** Input stream buffer over a memory region. */
+class memory_buffer_t : public window_buffer_t
+{
+public:
+    memory_buffer_t(const char* begin, const char* end)
+    {
+        auto* b = const_cast<char*>(begin);  // never written to
+        set_window(b, b + (end - begin));
+    }
+};
+
+/** Input stream over a memory region (e.g. a part of a memory mapped file). */
+class memory_stream_t : public std::istream
+{
+    memory_buffer_t buffer;
+
+public:
+    memory_stream_t(const char* begin, const char* end): std::istream{nullptr}, buffer{begin, end} { rdbuf(&buffer); }
+};
+
+/** Read-only memory mapping of a whole file.
+ * Falls back to reading the file into memory where mapping is not available. */
+class mapped_file_t
+{
+    const char* data{nullptr};
+    size_t length{0};
+    std::vector<char> copy;  ///< file contents when not mapped
+
+public:
+    /// Maps the file, throws std::system_error if it cannot be opened
+    explicit mapped_file_t(const std::string& path);
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+    ~mapped_file_t();
+    const char* begin() const { return data; }
+    const char* end() const { return data + length; }
+    size_t size() const { return length; }
+};
+
+/** Compression formats recognized by their magic numbers. */
+enum class compression_t { none, gzip, zstd };
+
+/** Recognizes the compression format from the first bytes of the data. */
+compression_t detect_compression(const char* data, size_t size);
+
+/** Opens the file for buffered reading, "-" denotes the standard input.
+ * Gzip and zstd compressed files are decompressed transparently on a separate thread ahead of the reader,
+ * using zlib and libzstd if available at build time, or else gzip and zstd commands (except for the standard input).
+ * @returns nullptr if the file cannot be opened (errno is set accordingly). */
+std::unique_ptr<std::istream> open_input(const std::string& path);
+
+/** Writes the value in little-endian byte order (binary output formats). */
+void write_u32(std::ostream&, uint32_t value);
+
+/** Writes the value in little-endian byte order (binary output formats). */
+void write_u64(std::ostream&, uint64_t value);
+
+/** Reads a value written by write_u32, throws std::runtime_error at the end of the input. */
+uint32_t read_u32(std::istream&);
+
+/** Reads a value written by write_u64, throws std::runtime_error at the end of the input. */
+uint64_t read_u64(std::istream&);
+
+/** Quotes the argument for use in a shell command. */
+std::string shell_quote(const std::string& arg);
+
+/** Input stream produced by a subprocess. */
+class process_stream_t : public std::istream
+{
+public:
+    using std::istream::istream;
+    /// Waits for the process to terminate and returns its exit status
+    virtual int wait() = 0;
+};
+
+/** Runs the UPPAAL model checker (verifyta or a compatible script) as a subprocess
+ * and streams its outputs without temporary files for the model and the trace. */
+class checker_t
+{
+public:
+    std::string path{"verifyta"};  ///< checker executable
+    std::string options{"-t0"};    ///< checker options for the diagnostic trace
+
+    /// Runs the checker with UPPAAL_COMPILE_ONLY=1 and returns the model in the intermediate format.
+    std::unique_ptr<process_stream_t> compile(const std::string& model) const;
+    /// Runs the verification of the query and returns the first diagnostic trace as it is being produced.
+    /// The checker output is forwarded to the standard error.
+    std::unique_ptr<process_stream_t> verify(const std::string& model, const std::string& query) const;
+};
+
+#endif  // TRACER_IO_HPP
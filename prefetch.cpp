@@ -0,0 +1,444 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+#include "prefetch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_FAST_POLL)  // the open, read and close operations and the probe are available since Linux 5.7
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define TRACER_URING
+#endif
+#endif
+
+namespace {
+constexpr size_t initial_size = 1u << 16;  ///< buffer size for reading a file of unknown size
+}
+
+#ifdef TRACER_URING
+
+/** Minimal io_uring over raw system calls: the submission and completion rings shared with the kernel. */
+struct prefetcher_t::uring_t
+{
+    int fd{-1};
+    io_uring_params params{};
+    void* sq_ring{MAP_FAILED};
+    void* cq_ring{MAP_FAILED};
+    size_t sq_ring_size{0};
+    size_t cq_ring_size{0};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    unsigned pending{0};  ///< entries queued but not submitted yet
+
+    template <typename T>
+    T* sq(unsigned offset) const
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(sq_ring) + offset);
+    }
+    template <typename T>
+    T* cq(unsigned offset) const
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(cq_ring) + offset);
+    }
+
+    /// Sets up the rings, throws std::system_error if io_uring or the file operations are not supported
+    explicit uring_t(unsigned entries)
+    {
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            throw std::system_error{errno, std::generic_category(), "io_uring_setup"};
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const auto single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            fail("mmap");
+        cq_ring = single ? sq_ring
+                         : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            fail("mmap");
+        auto* addr = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (addr == MAP_FAILED)
+            fail("mmap");
+        sqes = static_cast<io_uring_sqe*>(addr);
+        // Check that the kernel supports the file operations.
+        constexpr unsigned op_count = 256;
+        auto buffer = std::vector<char>(sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, op_count) < 0)
+            fail("io_uring_register");
+        for (auto op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE, IORING_OP_ASYNC_CANCEL})
+            if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)
+                fail("io_uring file operations", ENOSYS);
+    }
+    uring_t(const uring_t&) = delete;
+    uring_t& operator=(const uring_t&) = delete;
+    ~uring_t() { release(); }
+
+    void release()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (fd >= 0)
+            ::close(fd);
+        sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        sq_ring = cq_ring = MAP_FAILED;
+        fd = -1;
+    }
+
+    [[noreturn]] void fail(const char* what, int code = errno)
+    {
+        release();
+        throw std::system_error{code, std::generic_category(), what};
+    }
+
+    /// Queues the operation, submitting the queued ones first if the ring is full
+    void push(const io_uring_sqe& entry)
+    {
+        auto* tail = sq<unsigned>(params.sq_off.tail);
+        while (*tail - __atomic_load_n(sq<unsigned>(params.sq_off.head), __ATOMIC_ACQUIRE) == params.sq_entries)
+            if (const auto res = enter(0); res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY)
+                throw std::system_error{-res, std::generic_category(), "io_uring_enter"};
+        const auto index = *tail & *sq<unsigned>(params.sq_off.ring_mask);
+        sqes[index] = entry;
+        sq<unsigned>(params.sq_off.array)[index] = index;
+        __atomic_store_n(tail, *tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+    }
+
+    /// Submits the queued operations and waits for at least wait completions, returns -errno upon failure
+    int enter(unsigned wait)
+    {
+        const auto res = syscall(__NR_io_uring_enter, fd, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                 nullptr, 0);
+        if (res < 0)
+            return -errno;
+        pending -= static_cast<unsigned>(res);
+        return 0;
+    }
+
+    /// Calls complete(user_data, result) for every completed operation
+    template <typename Complete>
+    void reap(Complete&& complete)
+    {
+        auto* head = cq<unsigned>(params.cq_off.head);
+        const auto mask = *cq<unsigned>(params.cq_off.ring_mask);
+        const auto* cqes = cq<io_uring_cqe>(params.cq_off.cqes);
+        for (auto h = *head; h != __atomic_load_n(cq<unsigned>(params.cq_off.tail), __ATOMIC_ACQUIRE);) {
+            const auto entry = cqes[h & mask];
+            __atomic_store_n(head, ++h, __ATOMIC_RELEASE);
+            complete(entry.user_data, entry.res);
+        }
+    }
+};
+
+void prefetcher_t::read_uring()
+{
+    struct slot_t
+    {
+        prefetched_t file;
+        int fd{-1};      ///< file descriptor once open
+        size_t size{0};  ///< bytes read
+    };
+    auto slots = std::vector<slot_t>(depth);
+    auto in_flight = std::vector<bool>(depth);  ///< an open or a read of the slot is not completed yet
+    auto free_slots = std::vector<size_t>{};
+    for (auto i = depth; i > 0; --i)
+        free_slots.push_back(i - 1);
+    auto& uring = *ring;
+    // The user data of an operation is the slot number + 1, 0 for closing which is not waited for.
+    auto submit = [](uint8_t opcode, int fd, uint64_t user_data) {
+        auto entry = io_uring_sqe{};
+        entry.opcode = opcode;
+        entry.fd = fd;
+        entry.user_data = user_data;
+        return entry;
+    };
+    auto read = [&](size_t s) {
+        auto& slot = slots[s];
+        auto entry = submit(IORING_OP_READ, slot.fd, s + 1);
+        entry.addr = reinterpret_cast<uint64_t>(slot.file.data.data() + slot.size);
+        entry.len = static_cast<uint32_t>(slot.file.data.size() - slot.size);
+        entry.off = slot.size;
+        uring.push(entry);
+        in_flight[s] = true;
+    };
+    auto finish = [&](size_t s, int error) {
+        auto& slot = slots[s];
+        if (slot.fd >= 0)
+            uring.push(submit(IORING_OP_CLOSE, slot.fd, 0));
+        slot.fd = -1;
+        slot.file.error = error;
+        slot.file.data.resize(error == 0 && slot.file.complete ? slot.size : 0);
+        deliver(std::move(slot.file));
+        slot = slot_t{};
+        free_slots.push_back(s);
+    };
+    auto complete = [&](uint64_t user_data, int res) {
+        if (user_data == 0)
+            return;
+        const auto s = static_cast<size_t>(user_data - 1);
+        auto& slot = slots[s];
+        in_flight[s] = false;
+        if (res < 0)
+            return finish(s, -res);
+        if (slot.fd < 0) {  // opened
+            slot.fd = res;
+            slot.file.data.resize(initial_size);
+        } else if (res == 0) {  // end of file
+            return finish(s, 0);
+        } else if ((slot.size += res) == slot.file.data.size()) {
+            if (slot.size >= max_size) {
+                slot.file.complete = false;
+                return finish(s, 0);
+            }
+            slot.file.data.resize(std::min(slot.size * 2, size_t{max_size}));
+        }
+        read(s);
+    };
+    auto index = size_t{0};
+    try {
+        while (true) {
+            // Keep up to depth files ahead, waiting for the consumers only when no reads are in flight.
+            if (free_slots.size() == depth && uring.pending > 0)
+                uring.enter(0);  // close the files before waiting
+            while (!free_slots.empty() && start(index, free_slots.size() == depth)) {
+                const auto s = free_slots.back();
+                free_slots.pop_back();
+                slots[s].file.index = index;
+                auto entry = submit(IORING_OP_OPENAT, AT_FDCWD, s + 1);
+                entry.addr = reinterpret_cast<uint64_t>(files[index].c_str());
+                entry.open_flags = O_RDONLY | O_CLOEXEC;
+                uring.push(entry);
+                in_flight[s] = true;
+            }
+            if (free_slots.size() == depth)
+                break;
+            if (const auto res = uring.enter(1); res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY)
+                throw std::system_error{-res, std::generic_category(), "io_uring_enter"};
+            uring.reap(complete);
+        }
+        uring.enter(0);  // submit the last closes
+    } catch (...) {
+        // Closing the ring would not wait for the reads in flight, which could then write into freed buffers:
+        // cancel them and wait for their completions first.
+        try {
+            for (size_t s = 0; s < depth; ++s) {
+                if (in_flight[s]) {
+                    auto entry = submit(IORING_OP_ASYNC_CANCEL, -1, 0);
+                    entry.addr = s + 1;
+                    uring.push(entry);
+                }
+            }
+            uring.enter(0);  // also submits the closes queued before
+            while (std::find(in_flight.begin(), in_flight.end(), true) != in_flight.end()) {
+                if (const auto res = uring.enter(1); res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY)
+                    throw std::system_error{-res, std::generic_category(), "io_uring_enter"};
+                uring.reap([&](uint64_t user_data, int res) {
+                    if (user_data == 0)
+                        return;
+                    const auto s = static_cast<size_t>(user_data - 1);
+                    if (slots[s].fd < 0 && res >= 0)
+                        slots[s].fd = res;  // opened before the cancellation
+                    in_flight[s] = false;
+                });
+            }
+            for (const auto& slot : slots)
+                if (slot.fd >= 0)
+                    ::close(slot.fd);
+        } catch (...) {
+            // The kernel may still write into the buffers: keep them for the rest of the process.
+            static_cast<void>(new std::vector<slot_t>{std::move(slots)});
+        }
+        uring.release();
+        throw;
+    }
+}
+
+#else
+
+struct prefetcher_t::uring_t
+{};
+
+void prefetcher_t::read_uring() {}
+
+#endif
+
+void prefetcher_t::read_blocking()
+{
+    auto index = size_t{0};
+    while (start(index, true)) {
+        auto file = prefetched_t{};
+        file.index = index;
+        auto size = size_t{0};  // bytes read
+        auto grow = [&file, &size] {
+            if (size < file.data.size())
+                return true;
+            if (size >= max_size) {
+                file.complete = false;
+                return false;
+            }
+            file.data.resize(std::min(std::max(size * 2, initial_size), size_t{max_size}));
+            return true;
+        };
+#ifdef _WIN32
+        if (auto* f = std::fopen(files[index].c_str(), "rb"); f == nullptr) {
+            file.error = errno;
+        } else {
+            while (grow())
+                if (const auto count = std::fread(file.data.data() + size, 1, file.data.size() - size, f); count > 0)
+                    size += count;
+                else
+                    break;
+            if (std::ferror(f))
+                file.error = EIO;
+            std::fclose(f);
+        }
+#else
+        if (const auto fd = ::open(files[index].c_str(), O_RDONLY | O_CLOEXEC); fd < 0) {
+            file.error = errno;
+        } else {
+            struct stat info;
+            if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))  // the extra byte detects the end in one read
+                file.data.resize(std::min(static_cast<size_t>(info.st_size) + 1, size_t{max_size}));
+            while (grow()) {
+                const auto count = pread(fd, file.data.data() + size, file.data.size() - size, size);
+                if (count > 0) {
+                    size += count;
+                } else if (count == 0) {
+                    break;
+                } else if (errno != EINTR) {
+                    file.error = errno;
+                    break;
+                }
+            }
+            ::close(fd);
+        }
+#endif
+        file.data.resize(file.error == 0 && file.complete ? size : 0);
+        deliver(std::move(file));
+    }
+}
+
+prefetcher_t::prefetcher_t(const std::vector<std::string>& files, size_t depth):
+    files{files}, depth{std::max<size_t>(depth, 1)}
+{
+#ifdef TRACER_URING
+    try {
+        ring = std::make_unique<uring_t>(static_cast<unsigned>(2 * this->depth));
+        name = "io_uring";
+    } catch (std::system_error&) {
+        // e.g. old kernels or io_uring disabled in containers: read with blocking calls instead
+    }
+#endif
+    auto run = [this](void (prefetcher_t::*read)()) {
+        try {
+            (this->*read)();
+            finished(nullptr);
+        } catch (...) {
+            finished(std::current_exception());
+        }
+    };
+    const auto count = ring ? size_t{1} : std::min<size_t>(this->depth, 16);
+    running = count;
+    for (size_t i = 0; i < count; ++i)
+        readers.emplace_back(run, ring ? &prefetcher_t::read_uring : &prefetcher_t::read_blocking);
+}
+
+prefetcher_t::~prefetcher_t()
+{
+    stop();
+    for (auto& reader : readers)
+        reader.join();
+}
+
+bool prefetcher_t::start(size_t& index, bool wait)
+{
+    auto lock = std::unique_lock{mutex};
+    auto ahead = [this] { return ready.size() + active < depth; };
+    if (wait)
+        space.wait(lock, [&] { return stopped || next_file == files.size() || ahead(); });
+    if (stopped || next_file == files.size() || !ahead())
+        return false;
+    index = next_file++;
+    ++active;
+    return true;
+}
+
+void prefetcher_t::deliver(prefetched_t&& file)
+{
+    auto lock = std::lock_guard{mutex};
+    --active;
+    if (!stopped)
+        ready.push_back(std::move(file));
+    filled.notify_one();
+}
+
+void prefetcher_t::finished(std::exception_ptr failure)
+{
+    auto lock = std::lock_guard{mutex};
+    if (failure && !error)
+        error = failure;
+    --running;
+    filled.notify_all();
+}
+
+bool prefetcher_t::next(prefetched_t& file)
+{
+    auto lock = std::unique_lock{mutex};
+    filled.wait(lock, [this] { return stopped || !ready.empty() || running == 0; });
+    if (error)
+        std::rethrow_exception(error);
+    if (stopped || ready.empty())
+        return false;
+    file = std::move(ready.front());
+    ready.pop_front();
+    space.notify_one();
+    return true;
+}
+
+void prefetcher_t::stop()
+{
+    auto lock = std::lock_guard{mutex};
+    stopped = true;
+    ready.clear();
+    space.notify_all();
+    filled.notify_all();
+}
@@ -0,0 +1,94 @@
+#ifndef TRACER_PREFETCH_HPP
+#define TRACER_PREFETCH_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** File contents read ahead by the prefetcher. */
+struct prefetched_t
+{
+    size_t index{0};         ///< position in the file list
+    std::vector<char> data;  ///< file contents
+    int error{0};            ///< errno if the file could not be read
+    bool complete{true};     ///< false if the file is too large to be kept in memory and should be streamed instead
+};
+
+/** Reads many (small) files into memory ahead of their processing with many reads in flight.
+ * On Linux the files are opened, read and closed asynchronously through io_uring (raw system calls),
+ * submitting and completing the operations of many files per system call.
+ * Where io_uring is not available, a pool of threads reads the files with blocking pread calls.
+ * Files are delivered in the order of completion. */
+class prefetcher_t
+{
+public:
+    static constexpr size_t max_size = 1u << 26;  ///< larger files are not kept in memory (64MiB)
+
+private:
+    struct uring_t;
+    const std::vector<std::string>& files;
+    size_t depth;                    ///< maximum number of files being read or waiting to be processed
+    std::mutex mutex;
+    std::condition_variable space;   ///< signals the readers that another file can be read ahead
+    std::condition_variable filled;  ///< signals the consumers that a file is ready
+    std::deque<prefetched_t> ready;  ///< files read but not taken yet
+    size_t next_file{0};             ///< next file to start reading
+    size_t active{0};                ///< files being read
+    size_t running{0};               ///< reader threads still running
+    bool stopped{false};
+    std::exception_ptr error;        ///< failure of a reader thread
+    std::unique_ptr<uring_t> ring;   ///< io_uring instance if available
+    const char* name{"pread"};
+    std::vector<std::thread> readers;
+
+    /// Reserves the next file to read if fewer than depth files are ahead, optionally waiting for it.
+    /// @returns false if stopped, out of files or (without waiting) too many files are ahead
+    bool start(size_t& index, bool wait);
+    /// Passes the file read to the consumers
+    void deliver(prefetched_t&& file);
+    /// Reader thread returns, possibly with an error
+    void finished(std::exception_ptr failure);
+    /// Reads the files through the io_uring
+    void read_uring();
+    /// Reads the files one by one with blocking system calls
+    void read_blocking();
+
+public:
+    /// Starts reading the files (the list must outlive the prefetcher), keeping up to depth files ahead
+    prefetcher_t(const std::vector<std::string>& files, size_t depth);
+    prefetcher_t(const prefetcher_t&) = delete;
+    prefetcher_t& operator=(const prefetcher_t&) = delete;
+    ~prefetcher_t();
+    /// Waits for the next file read (in any order), returns false after all files or when stopped
+    bool next(prefetched_t& file);
+    /// Stops reading the remaining files
+    void stop();
+    /// The I/O mechanism in use: "io_uring" or "pread"
+    const char* backend() const { return name; }
+};
+
+#endif  // TRACER_PREFETCH_HPP
@@ -0,0 +1,299 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "ring.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr size_t header_size = 4096;  ///< the record area starts on the next page
+static_assert(sizeof(ring_header_t) <= header_size);
+constexpr char magic[8] = "TRACERR";
+
+/// Waits a little longer the longer the other side has been busy
+void back_off(unsigned& rounds)
+{
+    if (++rounds < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds{100});
+}
+}  // namespace
+
+#ifdef _WIN32
+
+ring_writer_t::ring_writer_t(const model_t& model, const std::string&, size_t): model{model}
+{
+    throw std::runtime_error{"shared-memory output is not supported on Windows"};
+}
+ring_writer_t::~ring_writer_t() = default;
+void ring_writer_t::wait_readers(size_t) {}
+void ring_writer_t::write(uint64_t, const Transition*, const State&) {}
+void ring_writer_t::close() {}
+
+ring_reader_t::ring_reader_t(const std::string&)
+{
+    throw std::runtime_error{"shared-memory output is not supported on Windows"};
+}
+ring_reader_t::~ring_reader_t() = default;
+const ring_record_t* ring_reader_t::next() { return nullptr; }
+
+#else
+
+ring_writer_t::ring_writer_t(const model_t& model, const std::string& name, size_t capacity):
+    model{model}, name{name}
+{
+    capacity = std::max<size_t>(capacity & ~size_t{7}, 4096);
+    ::shm_unlink(name.c_str());  // a ring left by a crashed run
+    const auto fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1)
+        throw std::system_error{errno, std::generic_category(), name};
+    mapped = header_size + capacity;
+    void* base = MAP_FAILED;
+    if (::ftruncate(fd, mapped) == 0)
+        base = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const auto error = errno;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw std::system_error{error, std::generic_category(), name};
+    }
+    header = new (base) ring_header_t{};
+    area = static_cast<char*>(base) + header_size;
+    header->format = ring_header_t::version;
+    header->processes = model.processes.size();
+    header->integers = model.integers.size();
+    header->clocks = model.clocks.size();
+    header->capacity = capacity;
+    for (auto& slot : header->readers)
+        slot.position.store(ring_header_t::unset);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, magic, sizeof(magic));  // last: the readers wait for it
+}
+
+ring_writer_t::~ring_writer_t()
+{
+    if (header == nullptr)
+        return;
+    close();
+    ::munmap(header, mapped);
+    ::shm_unlink(name.c_str());
+}
+
+void ring_writer_t::wait_readers(size_t count)
+{
+    for (auto rounds = 0u;; back_off(rounds)) {
+        auto registered = size_t{0};
+        for (const auto& slot : header->readers)
+            registered += slot.pid.load() != 0;
+        if (registered >= count)
+            return;
+    }
+}
+
+void ring_writer_t::wait_consumed(uint64_t end)
+{
+    const auto capacity = header->capacity;
+    for (auto& slot : header->readers) {
+        for (auto rounds = 0u;; back_off(rounds)) {
+            const auto position = slot.position.load();
+            if (position == ring_header_t::unset || position + capacity >= end)
+                break;
+            if (rounds % 1024 == 1023) {
+                // Release the slot of a reader that died without unregistering.
+                if (const auto pid = slot.pid.load(); pid > 0 && ::kill(pid, 0) == -1 && errno == ESRCH) {
+                    slot.position.store(ring_header_t::unset);
+                    slot.pid.store(0);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+char* ring_writer_t::reserve(uint32_t size)
+{
+    const auto capacity = header->capacity;
+    if (size > capacity)
+        throw std::runtime_error{"a step record of " + std::to_string(size) + " bytes does not fit into the ring"};
+    if (const auto offset = position % capacity; offset + size > capacity) {
+        const auto padding = static_cast<uint32_t>(capacity - offset);
+        wait_consumed(position + padding);
+        const uint32_t fill[2] = {padding, ring_record_t::padding};
+        std::memcpy(area + offset, fill, sizeof(fill));
+        publish(padding);
+    }
+    wait_consumed(position + size);
+    return area + position % capacity;
+}
+
+void ring_writer_t::publish(uint32_t size)
+{
+    position += size;
+    header->written.store(position, std::memory_order_release);
+}
+
+void ring_writer_t::write(uint64_t number, const Transition* transition, const State& state)
+{
+    const auto clock_count = model.clocks.size();
+    auto bounds = uint32_t{0};
+    auto implicit = [&](size_t i, size_t j) {
+        const auto& bnd = state.get_bound(clock_count, i, j);
+        const auto& dflt = (i == 0 || i == j) ? zero : infinity;
+        return bnd.value == dflt.value && bnd.strict == dflt.strict;
+    };
+    for (size_t i = 0; i < clock_count; ++i)
+        for (size_t j = 0; j < clock_count; ++j)
+            bounds += !implicit(i, j);
+    auto size = sizeof(ring_record_t) + 4 * (state.locations.size() + state.integers.size()) + 12 * bounds;
+    const auto edge_count = transition ? transition->edges.size() : 0;
+    if (transition)
+        for (const auto& e : transition->edges)
+            size += 12 + 4 * e.select.size();
+    size = (size + 7) & ~size_t{7};
+
+    auto* p = reserve(size);
+    const auto record = ring_record_t{static_cast<uint32_t>(size),
+                                      transition ? ring_record_t::step : ring_record_t::initial, number, bounds,
+                                      static_cast<uint32_t>(edge_count)};
+    std::memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    auto put = [&p](int32_t value) {
+        std::memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+    };
+    for (auto l : state.locations)
+        put(l);
+    for (auto v : state.integers)
+        put(v);
+    for (size_t i = 0; i < clock_count; ++i) {
+        for (size_t j = 0; j < clock_count; ++j) {
+            if (!implicit(i, j)) {
+                const auto& bnd = state.get_bound(clock_count, i, j);
+                put(i);
+                put(j);
+                put(bnd.value * 2 + bnd.strict);
+            }
+        }
+    }
+    if (transition) {
+        for (const auto& e : transition->edges) {
+            put(e.process);
+            put(e.edge);
+            put(e.select.size());
+            for (auto v : e.select)
+                put(v);
+        }
+    }
+    publish(size);
+}
+
+void ring_writer_t::close() { header->closed.store(1, std::memory_order_release); }
+
+ring_reader_t::ring_reader_t(const std::string& name)
+{
+    const auto fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1)
+        throw std::system_error{errno, std::generic_category(), name};
+    struct stat info;
+    void* base = MAP_FAILED;
+    if (::fstat(fd, &info) == 0 && info.st_size > static_cast<off_t>(header_size)) {
+        mapped = info.st_size;
+        base = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error{name + ": not a tracer ring (yet)"};
+    header = static_cast<ring_header_t*>(base);
+    area = static_cast<const char*>(base) + header_size;
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->format != ring_header_t::version ||
+        header->capacity + header_size != mapped) {
+        ::munmap(base, mapped);
+        throw std::runtime_error{name + ": not a tracer ring (yet)"};
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    for (auto& s : header->readers) {
+        auto free = int32_t{0};
+        if (s.pid.compare_exchange_strong(free, ::getpid())) {
+            slot = &s;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        ::munmap(base, mapped);
+        throw std::runtime_error{name + ": all " + std::to_string(ring_header_t::slots) + " reader slots are taken"};
+    }
+    // The writer may have checked the slot before the first store, so start after the records published
+    // before the store became visible, which the writer could not overwrite without seeing it.
+    slot->position.store(header->written.load());
+    position = header->written.load();
+    slot->position.store(position);
+}
+
+ring_reader_t::~ring_reader_t()
+{
+    if (header == nullptr)
+        return;
+    slot->position.store(ring_header_t::unset);
+    slot->pid.store(0);
+    ::munmap(header, mapped);
+}
+
+const ring_record_t* ring_reader_t::next()
+{
+    const auto capacity = header->capacity;
+    if (held != 0) {
+        position += std::exchange(held, 0);  // release the record returned before
+        slot->position.store(position, std::memory_order_release);
+    }
+    for (auto rounds = 0u;; back_off(rounds)) {
+        if (position == header->written.load(std::memory_order_acquire)) {
+            if (header->closed.load(std::memory_order_acquire) &&
+                position == header->written.load(std::memory_order_acquire))
+                return nullptr;
+            continue;
+        }
+        const auto* record = reinterpret_cast<const ring_record_t*>(area + position % capacity);
+        if (record->kind != ring_record_t::padding) {
+            held = record->size;
+            return record;
+        }
+        position += record->size;
+        slot->position.store(position, std::memory_order_release);
+        rounds = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef TRACER_RING_HPP
+#define TRACER_RING_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "tracer.hpp"
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/** Header of the shared-memory ring of step records, followed by the record area of `capacity` bytes.
+ * The producer (tracer) appends records and publishes them by advancing `written`, each consumer registers in a
+ * reader slot and advances its position after each record it has consumed. The producer never overwrites a record
+ * that a registered reader has not consumed yet, and readers see the records published after they registered.
+ * Positions are byte offsets counting from the start of the trace, the record is at position % capacity. */
+struct ring_header_t
+{
+    static constexpr uint32_t version = 1;
+    static constexpr size_t slots = 16;                ///< maximum number of readers
+    static constexpr uint64_t unset = UINT64_MAX;      ///< position of a slot not in use
+    char magic[8];            ///< "TRACERR\0"
+    uint32_t format;          ///< the version
+    uint32_t processes;       ///< number of locations per record
+    uint32_t integers;        ///< number of integers per record
+    uint32_t clocks;          ///< number of clocks indexed by the bounds
+    uint64_t capacity;        ///< bytes of the record area (a multiple of 8)
+    alignas(64) std::atomic<uint64_t> written;  ///< end of the published records
+    std::atomic<uint32_t> closed;               ///< 1 after the last record was published
+    struct slot_t
+    {
+        alignas(64) std::atomic<uint64_t> position;  ///< next record to consume, unset if the slot is free
+        std::atomic<int32_t> pid;                    ///< reader process, 0 if the slot is free
+    } readers[slots];
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring positions are shared between processes");
+
+/** A record in the ring, 8-byte aligned and padded to a multiple of 8 bytes, followed by
+ * int32 locations[processes] (index into the locations of each process as in the xtr format),
+ * int32 integers[integers],
+ * bounds times {uint32 i, uint32 j, int32 bound} (the DBM bounds on x_i - x_j other than the defaults,
+ * encoded as value * 2 + strict like in the xtr format) and
+ * edges times {uint32 process, uint32 edge, uint32 selects, int32 select[selects]} (the edges of the transition
+ * into the state as in the xtr format). */
+struct ring_record_t
+{
+    enum kind_t : uint32_t {
+        initial = 0,  ///< the initial state, without edges
+        step = 1,     ///< a transition and the state it leads to
+        padding = 2,  ///< fills the end of the record area before the next record wraps around, skip it
+    };
+    uint32_t size;    ///< bytes of the record including this header
+    uint32_t kind;
+    uint64_t number;  ///< step number, 0 for the initial state
+    uint32_t bounds;  ///< number of bounds
+    uint32_t edges;   ///< number of edges
+    const int32_t* data() const { return reinterpret_cast<const int32_t*>(this + 1); }
+};
+static_assert(sizeof(ring_record_t) == 24, "records are 8-byte aligned");
+
+/** Publishes the steps of a trace into a POSIX shared-memory ring (see ring_header_t) for local viewers,
+ * which consume the decoded states and transitions in place instead of parsing the text output.
+ * Throws std::system_error upon failure and std::runtime_error where shared memory is not supported. */
+class ring_writer_t
+{
+    const model_t& model;
+    std::string name;
+    ring_header_t* header{nullptr};
+    char* area{nullptr};
+    size_t mapped{0};        ///< bytes mapped including the header
+    uint64_t position{0};    ///< end of the records written
+
+    /// Waits until the readers have consumed the records up to the position
+    void wait_consumed(uint64_t end);
+    /// Reserves a contiguous record of size bytes, wrapping around the end of the area
+    char* reserve(uint32_t size);
+    void publish(uint32_t size);
+
+public:
+    /// Creates the ring with the name (e.g. "/tracer") and a record area of capacity bytes, replacing any ring
+    /// of the same name
+    ring_writer_t(const model_t&, const std::string& name, size_t capacity);
+    ring_writer_t(const ring_writer_t&) = delete;
+    ring_writer_t& operator=(const ring_writer_t&) = delete;
+    /// Closes the ring and removes its name, the readers attached keep reading the records left
+    ~ring_writer_t();
+    /// Waits until count readers have registered
+    void wait_readers(size_t count);
+    /// Appends the state (with the transition into it unless it is the initial state)
+    void write(uint64_t number, const Transition* transition, const State& state);
+    /// Marks the end of the records
+    void close();
+};
+
+/** Registers as a reader of the ring created by ring_writer_t and consumes its records in place.
+ * Throws std::system_error if the ring cannot be opened and std::runtime_error if it is not a ring or full. */
+class ring_reader_t
+{
+    ring_header_t* header{nullptr};
+    const char* area{nullptr};
+    size_t mapped{0};
+    ring_header_t::slot_t* slot{nullptr};
+    uint64_t position{0};  ///< next record to consume
+    uint32_t held{0};      ///< size of the record returned by next, not consumed yet
+
+public:
+    explicit ring_reader_t(const std::string& name);
+    ring_reader_t(const ring_reader_t&) = delete;
+    ring_reader_t& operator=(const ring_reader_t&) = delete;
+    /// Releases the reader slot
+    ~ring_reader_t();
+    const ring_header_t& info() const { return *header; }
+    /// Waits for the next record, returns nullptr after the last one.
+    /// The record stays valid until the next call, which releases it to the writer.
+    const ring_record_t* next();
+};
+
+#endif  // TRACER_RING_HPP
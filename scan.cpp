@@ -0,0 +1,330 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+#include "scan.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRACER_X86
+#endif
+
+namespace {
+constexpr size_t chunk_size = 1u << 16;  ///< bytes scanned at a time by line_index_t
+
+/// Scalar scan of the remaining bytes
+void newlines_scalar(const char* p, const char* end, std::vector<const char*>& newlines)
+{
+    while ((p = static_cast<const char*>(std::memchr(p, '\n', end - p))) != nullptr)
+        newlines.push_back(p++);
+}
+
+/// Number by number scan of the line
+bool ints_scalar(const char* p, const char* end, int* values, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const auto [next, error] = std::from_chars(skip_spaces(p, end), end, values[i]);
+        if (error != std::errc{})
+            return false;
+        p = next;
+    }
+    return skip_spaces(p, end) == end;
+}
+
+#ifdef TRACER_X86
+/// Appends the newlines marked in the mask of the bytes at p
+inline void push_mask(const char* p, uint64_t mask, std::vector<const char*>& newlines)
+{
+    if (mask == 0)
+        return;
+    const char* found[64];
+    auto count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        found[count++] = p + __builtin_ctzll(mask);
+    newlines.insert(newlines.end(), found, found + count);
+}
+
+__attribute__((target("sse2"))) void newlines_sse2(const char* p, const char* end, std::vector<const char*>& newlines)
+{
+    const auto nl = _mm_set1_epi8('\n');
+    for (; end - p >= 64; p += 64) {
+        auto mask = uint64_t{0};
+        for (int i = 0; i < 4; ++i) {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            mask |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, nl)))} << (16 * i);
+        }
+        push_mask(p, mask, newlines);
+    }
+    newlines_scalar(p, end, newlines);
+}
+
+__attribute__((target("avx2"))) void newlines_avx2(const char* p, const char* end, std::vector<const char*>& newlines)
+{
+    const auto nl = _mm256_set1_epi8('\n');
+    for (; end - p >= 64; p += 64) {
+        // 64 bytes per iteration: lines are short, hence the newlines are appended in batches.
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        const auto lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl)));
+        const auto hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl)));
+        push_mask(p, lo | uint64_t{hi} << 32, newlines);
+    }
+    newlines_sse2(p, end, newlines);
+}
+
+/// Classes of 64 bytes of a line of integers, one bit per byte
+struct ints_mask_t
+{
+    uint64_t digits;
+    uint64_t minus;
+    uint64_t valid;  ///< digits, minus signs, spaces and tabs
+};
+
+/// Converts the 1 to 8 decimal digits at s to their value, 8 bytes must be readable at s
+inline uint32_t eight_digits(const char* s, unsigned length)
+{
+    auto v = uint64_t{};
+    std::memcpy(&v, s, sizeof(v));
+    // Little endian: the first digit is the lowest byte, shifting drops the bytes after the number
+    // and leaves leading zeros. Then pairs, quadruples and octets of digits are combined at once.
+    v = (v & 0x0F0F0F0F0F0F0F0F) << 8 * (8 - length);
+    v = (v * 10 + (v >> 8)) & 0x00FF00FF00FF00FF;
+    v = (v * 100 + (v >> 16)) & 0x0000FFFF0000FFFF;
+    return static_cast<uint32_t>(v * 10000 + (v >> 32));
+}
+
+/** Parses a line of at least 64 bytes using classify to find the digits of 64 bytes at a time. */
+template <ints_mask_t (*classify)(const char*)>
+inline __attribute__((always_inline)) bool ints_blocks(const char* begin, const char* end, int* values, size_t count)
+{
+    auto n = size_t{0};
+    auto minuses = 0, negatives = 0;
+    auto carry = uint64_t{0};        // the byte before the block is a digit
+    auto minus_carry = uint64_t{0};  // the byte before the block is a minus
+    for (const auto* p = begin; p != end; p += 64) {
+        auto fresh = ~uint64_t{0};  // bytes not seen in the previous block
+        if (end - p < 64) {
+            // The last block overlaps the previous one, which then provides the carries.
+            fresh <<= 64 - (end - p);
+            p = end - 64;
+            carry = minus_carry = 0;
+        }
+        const auto m = classify(p);
+        if (m.valid != ~uint64_t{0})
+            return false;
+        minuses += __builtin_popcountll(m.minus & fresh);
+        auto starts = m.digits & ~(m.digits << 1 | carry) & fresh;
+        const auto signs = m.minus << 1 | minus_carry;  // numbers preceded by a minus
+        carry = m.digits >> 63;
+        minus_carry = m.minus >> 63;
+        if (n + __builtin_popcountll(starts) > count)
+            return false;
+        for (; starts != 0; starts &= starts - 1) {
+            const auto bit = __builtin_ctzll(starts);
+            const auto* s = p + bit;
+            const auto length = static_cast<unsigned>(__builtin_ctzll(~(m.digits >> bit)));
+            const auto negative = static_cast<uint32_t>(signs >> bit) & 1;
+            negatives += negative;
+            if (length > 8 || (bit + length == 64 && p + 64 != end)) {
+                // Long number or continued in the next block
+                const auto [next, error] = std::from_chars(s - negative, end, values[n++]);
+                if (error != std::errc{})
+                    return false;
+                continue;
+            }
+            auto value = uint32_t{0};
+            if (end - s >= 8) {
+                value = eight_digits(s, length);
+            } else {
+                for (const auto* d = s; d != s + length; ++d)
+                    value = value * 10 + (*d - '0');
+            }
+            values[n++] = static_cast<int>((value ^ -negative) + negative);  // two's complement negation
+        }
+    }
+    return n == count && minuses == negatives;
+}
+
+__attribute__((target("sse2"))) inline ints_mask_t classify_sse2(const char* p)
+{
+    const auto zero = _mm_set1_epi8('0');
+    const auto nine = _mm_set1_epi8(9);
+    const auto minus = _mm_set1_epi8('-');
+    const auto space = _mm_set1_epi8(' ');
+    const auto tab = _mm_set1_epi8('\t');
+    auto res = ints_mask_t{0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        const auto value = _mm_sub_epi8(bytes, zero);
+        const auto digits = _mm_cmpeq_epi8(_mm_min_epu8(value, nine), value);
+        const auto minuses = _mm_cmpeq_epi8(bytes, minus);
+        const auto spaces = _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab));
+        const auto valid = _mm_or_si128(_mm_or_si128(digits, minuses), spaces);
+        res.digits |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(digits))} << (16 * i);
+        res.minus |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(minuses))} << (16 * i);
+        res.valid |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(valid))} << (16 * i);
+    }
+    return res;
+}
+
+__attribute__((target("avx2"))) inline ints_mask_t classify_avx2(const char* p)
+{
+    const auto zero = _mm256_set1_epi8('0');
+    const auto nine = _mm256_set1_epi8(9);
+    const auto minus = _mm256_set1_epi8('-');
+    const auto space = _mm256_set1_epi8(' ');
+    const auto tab = _mm256_set1_epi8('\t');
+    auto res = ints_mask_t{0, 0, 0};
+    for (int i = 0; i < 2; ++i) {
+        const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+        const auto value = _mm256_sub_epi8(bytes, zero);
+        const auto digits = _mm256_cmpeq_epi8(_mm256_min_epu8(value, nine), value);
+        const auto minuses = _mm256_cmpeq_epi8(bytes, minus);
+        const auto spaces = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, tab));
+        const auto valid = _mm256_or_si256(_mm256_or_si256(digits, minuses), spaces);
+        res.digits |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(digits))} << (32 * i);
+        res.minus |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(minuses))} << (32 * i);
+        res.valid |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(valid))} << (32 * i);
+    }
+    return res;
+}
+
+__attribute__((target("sse2"))) bool ints_sse2(const char* begin, const char* end, int* values, size_t count)
+{
+    return ints_blocks<classify_sse2>(begin, end, values, count);
+}
+
+__attribute__((target("avx2"))) bool ints_avx2(const char* begin, const char* end, int* values, size_t count)
+{
+    return ints_blocks<classify_avx2>(begin, end, values, count);
+}
+#endif
+
+simd_t detect()
+{
+    auto res = simd_t::scalar;
+#ifdef TRACER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        res = simd_t::avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        res = simd_t::sse2;
+#endif
+    if (const auto* limit = std::getenv("TRACER_SIMD"); limit != nullptr) {
+        for (auto level : {simd_t::scalar, simd_t::sse2})
+            if (std::strcmp(limit, simd_name(level)) == 0)
+                res = std::min(res, level);
+    }
+    return res;
+}
+
+using newlines_fn = void (*)(const char*, const char*, std::vector<const char*>&);
+
+newlines_fn select_newlines()
+{
+    switch (simd_level()) {
+#ifdef TRACER_X86
+    case simd_t::avx2: return &newlines_avx2;
+    case simd_t::sse2: return &newlines_sse2;
+#endif
+    default: return &newlines_scalar;
+    }
+}
+
+using ints_fn = bool (*)(const char*, const char*, int*, size_t);
+
+ints_fn select_ints()
+{
+    switch (simd_level()) {
+#ifdef TRACER_X86
+    case simd_t::avx2: return &ints_avx2;
+    case simd_t::sse2: return &ints_sse2;
+#endif
+    default: return &ints_scalar;
+    }
+}
+}  // namespace
+
+simd_t simd_level()
+{
+    static const auto level = detect();
+    return level;
+}
+
+const char* simd_name(simd_t level)
+{
+    switch (level) {
+    case simd_t::avx2: return "avx2";
+    case simd_t::sse2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+void find_newlines(const char* begin, const char* end, std::vector<const char*>& newlines)
+{
+    static const auto impl = select_newlines();
+    impl(begin, end, newlines);
+}
+
+bool parse_ints(std::string_view line, int* values, size_t count)
+{
+    static const auto impl = select_ints();
+    const auto* begin = line.data();
+    if (line.size() < 64)
+        return ints_scalar(begin, begin + line.size(), values, count);
+    return impl(begin, begin + line.size(), values, count);
+}
+
+void line_index_t::seek(const char* pos, const char* end, uint64_t fill)
+{
+    if (fill != this->fill || end != this->end || pos < base) {
+        // Another window: start a new index.
+        base = scanned = pos;
+        this->end = end;
+        this->fill = fill;
+        ends.clear();
+        next = 0;
+    }
+    while (next < ends.size() && ends[next] < pos)
+        ++next;
+    if (next > 4096 && next * 2 > ends.size()) {  // drop the lines taken
+        ends.erase(ends.begin(), ends.begin() + next);
+        next = 0;
+    }
+    scanned = std::max(scanned, pos);
+    this->pos = pos;
+}
+
+bool line_index_t::next_line(std::string_view& line)
+{
+    while (next == ends.size()) {
+        if (scanned == end)
+            return false;
+        const auto* chunk_end = end - scanned > static_cast<ptrdiff_t>(chunk_size) ? scanned + chunk_size : end;
+        find_newlines(scanned, chunk_end, ends);
+        scanned = chunk_end;
+    }
+    const auto* line_end = ends[next++];
+    line = std::string_view{pos, static_cast<size_t>(line_end - pos)};
+    pos = line_end + 1;
+    return true;
+}
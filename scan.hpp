@@ -0,0 +1,78 @@
+#ifndef TRACER_SCAN_HPP
+#define TRACER_SCAN_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/** Vector instruction sets used by the scanners, the best one supported by the CPU is selected at run time.
+ * The environment variable TRACER_SIMD=scalar|sse2|avx2 restricts the selection (e.g. for benchmarking). */
+enum class simd_t { scalar, sse2, avx2 };
+
+/** The instruction set in use. */
+simd_t simd_level();
+
+/** Name of the instruction set. */
+const char* simd_name(simd_t);
+
+/** Appends the positions of the newlines in the text to the list. */
+void find_newlines(const char* begin, const char* end, std::vector<const char*>& newlines);
+
+/** Skips the spaces and tabs, returns the first other position. */
+inline const char* skip_spaces(const char* p, const char* end)
+{
+    while (p != end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+/** Parses exactly count integers separated by spaces or tabs filling the line.
+ * Long lines (e.g. the locations and variables of large models) are classified 64 bytes at a time with vector
+ * instructions and the digits of each number are converted together, short lines are parsed number by number.
+ * @returns false if the line contains anything else, another number of integers or an integer out of range */
+bool parse_ints(std::string_view line, int* values, size_t count);
+
+/** Structural index of a buffered text window: the ends of its lines, found by find_newlines a chunk at a time
+ * as the lines are taken, so that the parser gets whole lines without scanning for their ends byte by byte. */
+class line_index_t
+{
+    const char* base{nullptr};     ///< start of the indexed part of the window
+    const char* end{nullptr};      ///< end of the window
+    const char* scanned{nullptr};  ///< end of the scanned part
+    const char* pos{nullptr};      ///< start of the next line
+    uint64_t fill{0};              ///< identifies the buffer contents of the window
+    std::vector<const char*> ends;  ///< newlines found, from ends[next] on after pos
+    size_t next{0};
+
+public:
+    /// Continues at the position in the window [pos, end) of the buffer contents fill,
+    /// reusing the lines scanned before if the window is the same.
+    void seek(const char* pos, const char* end, uint64_t fill);
+    /// Takes the next complete line (without the newline), returns false if no complete line is left in the window
+    bool next_line(std::string_view& line);
+    /// Start of the next line
+    const char* position() const { return pos; }
+    /// True if all complete lines of the window have been taken
+    bool exhausted() const { return next == ends.size() && scanned == end; }
+};
+
+#endif  // TRACER_SCAN_HPP
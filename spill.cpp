@@ -0,0 +1,122 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "spill.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+spill_file_t::spill_file_t(spill_file_t&& other) noexcept:
+    fd{std::exchange(other.fd, -1)}, length{std::exchange(other.length, 0)},
+    mapped{std::exchange(other.mapped, nullptr)}, mapped_length{std::exchange(other.mapped_length, 0)}
+{}
+
+spill_file_t& spill_file_t::operator=(spill_file_t&& other) noexcept
+{
+    std::swap(fd, other.fd);
+    std::swap(length, other.length);
+    std::swap(mapped, other.mapped);
+    std::swap(mapped_length, other.mapped_length);
+    return *this;
+}
+
+#ifdef _WIN32
+
+// spill_list_t keeps everything in memory on Windows
+spill_file_t::~spill_file_t() = default;
+void spill_file_t::unmap() const {}
+void spill_file_t::append(const void*, size_t) { throw std::logic_error{"spilling is not supported on Windows"}; }
+void spill_file_t::truncate(size_t) {}
+const void* spill_file_t::data() const { return nullptr; }
+
+#else
+
+spill_file_t::~spill_file_t()
+{
+    unmap();
+    if (fd != -1)
+        ::close(fd);
+}
+
+void spill_file_t::unmap() const
+{
+    if (mapped != nullptr)
+        ::munmap(const_cast<void*>(mapped), mapped_length);
+    mapped = nullptr;
+    mapped_length = 0;
+}
+
+void spill_file_t::append(const void* data, size_t size)
+{
+    if (fd == -1) {
+        auto path = (std::filesystem::temp_directory_path() / "tracer-spill-XXXXXX").string();
+        fd = ::mkstemp(path.data());
+        if (fd == -1)
+            throw std::system_error{errno, std::generic_category(), path};
+        ::unlink(path.c_str());  // the space is released when the file is closed, even upon a crash
+    }
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        const auto written = ::pwrite(fd, p, size, length);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error{errno, std::generic_category(), "cannot spill the trace to disk"};
+        }
+        p += written;
+        size -= written;
+        length += written;
+    }
+}
+
+void spill_file_t::truncate(size_t size)
+{
+    if (size >= length)
+        return;
+    unmap();
+    length = size;
+    if (::ftruncate(fd, size) == -1)
+        throw std::system_error{errno, std::generic_category(), "cannot truncate the spilled trace"};
+}
+
+const void* spill_file_t::data() const
+{
+    if (mapped_length != length) {
+        unmap();
+        if (length == 0)
+            return nullptr;
+        auto* p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            throw std::system_error{errno, std::generic_category(), "cannot map the spilled trace"};
+        ::madvise(p, length, MADV_SEQUENTIAL);
+        mapped = p;
+        mapped_length = length;
+    }
+    return mapped;
+}
+
+#endif
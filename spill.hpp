@@ -0,0 +1,128 @@
+#ifndef TRACER_SPILL_HPP
+#define TRACER_SPILL_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+
+/** Unlinked temporary file holding raw records that do not fit into the memory budget,
+ * mapped back into memory on demand so that the operating system pages them in and out as they are visited. */
+class spill_file_t
+{
+    int fd{-1};                          ///< the file, -1 until the first append
+    size_t length{0};                    ///< bytes written
+    mutable const void* mapped{nullptr};  ///< the file mapped into memory
+    mutable size_t mapped_length{0};      ///< bytes mapped
+
+    void unmap() const;
+
+public:
+    spill_file_t() = default;
+    spill_file_t(spill_file_t&& other) noexcept;
+    spill_file_t& operator=(spill_file_t&& other) noexcept;
+    spill_file_t(const spill_file_t&) = delete;
+    spill_file_t& operator=(const spill_file_t&) = delete;
+    ~spill_file_t();
+    /// Appends the bytes, creating the file in the temporary directory first, throws std::system_error on failure
+    void append(const void* data, size_t size);
+    /// Drops the bytes from size on
+    void truncate(size_t size);
+    /// The contents of the file, valid until the file changes
+    const void* data() const;
+    size_t size() const { return length; }
+};
+
+/** Sequence of trivially copyable records within a memory budget: the records beyond the budget are spilled
+ * to a spill_file_t and read back through its mapping. Without a budget (or on Windows) all records stay in memory.
+ * References to records are valid until the list changes. */
+template <typename T>
+class spill_list_t
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    static constexpr size_t unlimited = std::numeric_limits<size_t>::max();
+
+private:
+    size_t limit{unlimited};       ///< maximum number of records kept in memory
+    std::vector<T> recent;         ///< the records after the spilled ones
+    size_t spilled{0};             ///< number of records in the file
+    spill_file_t file;
+    mutable const T* mapped{nullptr};  ///< file contents for the spilled records
+
+    /// Moves the recent records to the file
+    void spill()
+    {
+        file.append(recent.data(), recent.size() * sizeof(T));
+        spilled += recent.size();
+        recent.clear();
+        mapped = nullptr;
+    }
+    const T& spilled_at(size_t i) const
+    {
+        if (mapped == nullptr)
+            mapped = static_cast<const T*>(file.data());
+        return mapped[i];
+    }
+
+public:
+    spill_list_t() = default;
+    /// Keeps at most budget bytes of records in memory
+    explicit spill_list_t(size_t budget):
+        limit{budget == unlimited ? unlimited : std::max<size_t>(budget / sizeof(T), 1)}
+    {
+#ifdef _WIN32
+        limit = unlimited;
+#endif
+    }
+    void push_back(const T& record)
+    {
+        if (recent.size() == limit)
+            spill();
+        else if (recent.empty() && limit != unlimited)
+            recent.reserve(limit);  // the budget is the capacity, pages are not touched before they are filled
+        recent.push_back(record);
+    }
+    const T& operator[](size_t i) const { return i < spilled ? spilled_at(i) : recent[i - spilled]; }
+    const T& back() const { return (*this)[size() - 1]; }
+    size_t size() const { return spilled + recent.size(); }
+    bool empty() const { return size() == 0; }
+    /// Drops the records from count on (the list cannot grow this way)
+    void resize(size_t count)
+    {
+        if (count >= spilled) {
+            recent.resize(std::min(count - spilled, recent.size()));
+        } else {
+            recent.clear();
+            spilled = count;
+            file.truncate(count * sizeof(T));
+            mapped = nullptr;
+        }
+    }
+    void clear() { resize(0); }
+    /// Number of records in the file
+    size_t spilled_count() const { return spilled; }
+};
+
+#endif  // TRACER_SPILL_HPP
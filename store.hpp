@@ -0,0 +1,260 @@
+#ifndef TRACER_STORE_HPP
+#define TRACER_STORE_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+/** Hashes raw bytes. The bulk is processed in eight independent 32-bit lanes,
+ * which the compiler maps onto SIMD multiplications, and the lanes are mixed at the end. */
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    constexpr uint32_t prime1 = 0x9E3779B1u;
+    constexpr uint32_t prime2 = 0x85EBCA77u;
+    constexpr uint64_t prime64 = 0x9E3779B97F4A7C15ull;
+    const auto* p = static_cast<const unsigned char*>(data);
+    uint32_t lanes[8];
+    for (uint32_t l = 0; l < 8; ++l)
+        lanes[l] = static_cast<uint32_t>(seed) + prime1 * (l + 1);
+    const auto blocks = size / sizeof(lanes);
+    for (size_t b = 0; b < blocks; ++b, p += sizeof(lanes)) {
+        uint32_t words[8];
+        std::memcpy(words, p, sizeof(words));
+        for (int l = 0; l < 8; ++l) {
+            lanes[l] += words[l] * prime2;
+            lanes[l] = (lanes[l] << 13) | (lanes[l] >> 19);
+            lanes[l] *= prime1;
+        }
+    }
+    auto h = seed ^ (size * prime64);
+    for (auto lane : lanes)
+        h = (h ^ lane) * prime64;
+    for (size = size % sizeof(lanes); size >= 4; size -= 4, p += 4) {
+        uint32_t word;
+        std::memcpy(&word, p, sizeof(word));
+        h = (h ^ word) * prime64;
+    }
+    for (; size > 0; --size, ++p)
+        h = (h ^ *p) * prime64;
+    return h ^ (h >> 32);
+}
+
+/** Hash-consing pool of arrays: equal arrays are stored only once and identified by a small dense ID.
+ * Arrays are stored back to back and looked up in an open addressing hash table. */
+template <typename T>
+class array_pool_t
+{
+    static_assert(std::has_unique_object_representations_v<T>, "equal values must have equal bytes");
+
+public:
+    using id_t = uint32_t;
+
+private:
+    std::vector<T> values;             ///< concatenated arrays
+    std::vector<size_t> offsets{0};    ///< array #id spans [offsets[id], offsets[id+1]) in values
+    std::vector<uint64_t> hashes;      ///< hash of each array
+    std::vector<id_t> table = {0, 0};  ///< id+1 of arrays at their hash positions, 0 marks an empty slot
+
+    void rehash()
+    {
+        table.assign(table.size() * 2, 0);
+        const auto mask = table.size() - 1;
+        for (id_t id = 0; id < hashes.size(); ++id) {
+            auto i = hashes[id] & mask;
+            while (table[i] != 0)
+                i = (i + 1) & mask;
+            table[i] = id + 1;
+        }
+    }
+
+public:
+    /// Returns the ID of the array, the array is added if it was not seen before.
+    id_t intern(const T* data, size_t size) { return intern(data, size, hash_bytes(data, size * sizeof(T))); }
+    /// Interns the array with its hash_bytes hash already computed.
+    id_t intern(const T* data, size_t size, uint64_t hash)
+    {
+        const auto mask = table.size() - 1;
+        auto i = hash & mask;
+        for (; table[i] != 0; i = (i + 1) & mask) {
+            const auto id = table[i] - 1;
+            if (hashes[id] == hash && this->size(id) == size &&
+                (size == 0 || std::memcmp(begin(id), data, size * sizeof(T)) == 0))
+                return id;
+        }
+        const auto id = static_cast<id_t>(hashes.size());
+        values.insert(values.end(), data, data + size);
+        offsets.push_back(values.size());
+        hashes.push_back(hash);
+        table[i] = id + 1;
+        if (hashes.size() * 2 > table.size())
+            rehash();
+        return id;
+    }
+    id_t intern(const std::vector<T>& array) { return intern(array.data(), array.size()); }
+    const T* begin(id_t id) const
+    {
+        assert(id < hashes.size());
+        return values.data() + offsets[id];
+    }
+    const T* end(id_t id) const { return values.data() + offsets[id + 1]; }
+    size_t size(id_t id) const { return offsets[id + 1] - offsets[id]; }
+    uint64_t hash(id_t id) const { return hashes[id]; }
+    /// Copies the array into the vector
+    void load(id_t id, std::vector<T>& array) const { array.assign(begin(id), end(id)); }
+    /// Number of distinct arrays
+    size_t count() const { return hashes.size(); }
+    /// Number of bytes allocated
+    size_t memory() const
+    {
+        return values.capacity() * sizeof(T) + offsets.capacity() * sizeof(size_t) +
+               hashes.capacity() * sizeof(uint64_t) + table.capacity() * sizeof(id_t);
+    }
+    void clear()
+    {
+        values.clear();
+        offsets.assign(1, 0);
+        hashes.clear();
+        table.assign(2, 0);
+    }
+};
+
+/** Thread-safe hash-consing pool: arrays are distributed by their hash over independently locked shards.
+ * The shard index is kept in the low bits of the ID. */
+template <typename T, size_t Bits = 6>
+class sharded_pool_t
+{
+public:
+    using id_t = uint32_t;
+
+private:
+    static constexpr id_t mask = (1u << Bits) - 1;
+    struct shard_t
+    {
+        mutable std::mutex mutex;
+        array_pool_t<T> pool;
+    };
+    std::array<shard_t, 1u << Bits> shards;
+
+public:
+    id_t intern(const T* data, size_t size)
+    {
+        const auto hash = hash_bytes(data, size * sizeof(T));
+        const auto index = static_cast<id_t>(hash >> 32) & mask;  // the low bits address the shard tables
+        auto& shard = shards[index];
+        auto lock = std::lock_guard{shard.mutex};
+        return (shard.pool.intern(data, size, hash) << Bits) | index;
+    }
+    id_t intern(const std::vector<T>& array) { return intern(array.data(), array.size()); }
+    void load(id_t id, std::vector<T>& array) const
+    {
+        const auto& shard = shards[id & mask];
+        auto lock = std::lock_guard{shard.mutex};
+        shard.pool.load(id >> Bits, array);
+    }
+    /// Hash of the contents, the same for equal arrays whatever their IDs
+    uint64_t hash(id_t id) const
+    {
+        const auto& shard = shards[id & mask];
+        auto lock = std::lock_guard{shard.mutex};
+        return shard.pool.hash(id >> Bits);
+    }
+    size_t count() const
+    {
+        auto res = size_t{0};
+        for (const auto& shard : shards) {
+            auto lock = std::lock_guard{shard.mutex};
+            res += shard.pool.count();
+        }
+        return res;
+    }
+    size_t memory() const
+    {
+        auto res = size_t{0};
+        for (const auto& shard : shards) {
+            auto lock = std::lock_guard{shard.mutex};
+            res += shard.pool.memory();
+        }
+        return res;
+    }
+    void clear()
+    {
+        for (auto& shard : shards) {
+            auto lock = std::lock_guard{shard.mutex};
+            shard.pool.clear();
+        }
+    }
+};
+
+/** Thread-safe hash map: entries are distributed by their hash over independently locked shards. */
+template <typename Key, typename Value, typename Hash = std::hash<Key>, size_t Bits = 6>
+class concurrent_map_t
+{
+    struct shard_t
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+    std::array<shard_t, 1u << Bits> shards;
+    Hash hasher;
+
+    shard_t& shard(const Key& key)
+    {
+        const auto h = static_cast<uint64_t>(hasher(key));
+        return shards[((h * 0x9E3779B97F4A7C15ull) >> 32) & ((1u << Bits) - 1)];
+    }
+
+public:
+    /// Calls update(value, inserted) on the entry while holding its shard lock, the value is default-constructed if new.
+    template <typename Update>
+    void update(const Key& key, Update&& update)
+    {
+        auto& s = shard(key);
+        auto lock = std::lock_guard{s.mutex};
+        auto [it, inserted] = s.map.try_emplace(key);
+        update(it->second, inserted);
+    }
+    /// Calls visit(key, value) for every entry, must not run concurrently with updates.
+    template <typename Visit>
+    void for_each(Visit&& visit) const
+    {
+        for (const auto& s : shards)
+            for (const auto& [key, value] : s.map)
+                visit(key, value);
+    }
+    size_t size() const
+    {
+        auto res = size_t{0};
+        for (const auto& s : shards) {
+            auto lock = std::lock_guard{s.mutex};
+            res += s.map.size();
+        }
+        return res;
+    }
+};
+
+#endif  // TRACER_STORE_HPP
@@ -0,0 +1,138 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "timeline.hpp"
+
+#include "io.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+/** Time interval of a state. */
+struct interval_t
+{
+    int32_t earliest{0}, latest{0};
+};
+
+interval_t time_interval(const State& state, size_t clock_count, size_t clock)
+{
+    thread_local auto lower = std::vector<bound_t>{}, upper = std::vector<bound_t>{};
+    state.clock_bounds(clock_count, lower, upper);
+    return {-lower[clock].value, upper[clock].value == infinity.value ? residence_t::unbounded : upper[clock].value};
+}
+
+void write_string(std::ostream& os, const std::string& str)
+{
+    write_u32(os, str.size());
+    os.write(str.data(), str.size());
+}
+
+void write_time(std::ostream& os, int32_t time)
+{
+    if (time == residence_t::unbounded)
+        os << "inf";
+    else
+        os << time;
+}
+}  // namespace
+
+void read_residences(const model_t& model, std::istream& is, const std::function<void(const residence_t&)>& emit)
+{
+    const auto time = std::find(model.clocks.begin(), model.clocks.end(), "#time");
+    if (time == model.clocks.end())
+        throw std::invalid_argument{"the model has no #time clock"};
+    const auto clock = static_cast<size_t>(time - model.clocks.begin());
+    const auto clock_count = model.clocks.size();
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    auto interval = time_interval(step.state, clock_count, clock);
+    auto current = std::vector<residence_t>(model.processes.size());
+    for (uint32_t p = 0; p < current.size(); ++p)
+        current[p] = {p, uint32_t(step.state.locations[p]), 0, 0, false, interval.earliest, interval.latest,
+                      interval.earliest, interval.latest};
+    auto n = uint32_t{0};
+    while (reader.next(step)) {
+        ++n;
+        interval = time_interval(step.state, clock_count, clock);
+        for (auto& r : current) {
+            if (step.state.locations[r.process] != static_cast<int>(r.location)) {
+                r.exit = n;
+                emit(r);
+                r.location = step.state.locations[r.process];
+                r.entry = n;
+                r.entry_earliest = interval.earliest;
+                r.entry_latest = interval.latest;
+            }
+            r.exit_earliest = interval.earliest;
+            r.exit_latest = interval.latest;
+        }
+    }
+    for (auto& r : current) {
+        r.exit = n;
+        r.open = true;
+        emit(r);
+    }
+}
+
+std::ostream& write_residence_header(std::ostream& os)
+{
+    return os << "process,location,entry_step,exit_step,open,entry_earliest,entry_latest,exit_earliest,exit_latest\n";
+}
+
+std::ostream& write_residence_csv(const model_t& model, const residence_t& r, std::ostream& os)
+{
+    const auto& process = model.processes[r.process];
+    os << process.name << ',' << model.layout[process.locations[r.location]].name << ',' << r.entry << ',' << r.exit
+       << ',' << (r.open ? 1 : 0) << ',' << r.entry_earliest << ',';
+    write_time(os, r.entry_latest);
+    os << ',' << r.exit_earliest << ',';
+    write_time(os, r.exit_latest);
+    return os << '\n';
+}
+
+std::ostream& write_timeline_header(const model_t& model, std::ostream& os)
+{
+    os.write("TRACERT", 8);  // including the terminating zero
+    write_u32(os, 1);        // version
+    write_u32(os, model.processes.size());
+    for (const auto& process : model.processes) {
+        write_string(os, process.name);
+        write_u32(os, process.locations.size());
+        for (auto l : process.locations)
+            write_string(os, model.layout[l].name);
+    }
+    return os;
+}
+
+std::ostream& write_residence_binary(const residence_t& r, std::ostream& os)
+{
+    write_u32(os, r.process);
+    write_u32(os, r.location);
+    write_u32(os, r.entry);
+    write_u32(os, r.exit | (r.open ? 0x80000000u : 0u));
+    write_u32(os, r.entry_earliest);
+    write_u32(os, r.entry_latest);
+    write_u32(os, r.exit_earliest);
+    write_u32(os, r.exit_latest);
+    return os;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACER_TIMELINE_HPP
+#define TRACER_TIMELINE_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+
+#include "tracer.hpp"
+
+#include <functional>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+/** A stay of a process in a location along a trace (a bar of a Gantt chart). */
+struct residence_t
+{
+    static constexpr int32_t unbounded = std::numeric_limits<int32_t>::max();  ///< no upper time bound
+
+    uint32_t process{0};   ///< process index in model_t::processes
+    uint32_t location{0};  ///< location index in process_t::locations
+    uint32_t entry{0};     ///< the step entering the location (0 for the initial state)
+    uint32_t exit{0};      ///< the step leaving the location (the number of steps if still there at the end)
+    bool open{false};      ///< the process is still in the location at the end of the trace
+    int32_t entry_earliest{0}, entry_latest{0};  ///< #time bounds of the state entering the location
+    int32_t exit_earliest{0}, exit_latest{0};    ///< #time bounds of the last state in the location
+};
+
+/** Reads the trace step by step and calls emit for each residence as soon as the process leaves the location,
+ * then for the residences still open at the end of the trace. Throws std::invalid_argument if there is no #time clock. */
+void read_residences(const model_t&, std::istream&, const std::function<void(const residence_t&)>& emit);
+
+/** Writes the residence as a line of comma separated values (see write_residence_header). */
+std::ostream& write_residence_csv(const model_t&, const residence_t&, std::ostream&);
+/** Writes the header line of the comma separated values. */
+std::ostream& write_residence_header(std::ostream&);
+
+/** Writes the header of the binary timeline: the process and location names (see README). */
+std::ostream& write_timeline_header(const model_t&, std::ostream&);
+/** Writes the residence as a binary timeline record. */
+std::ostream& write_residence_binary(const residence_t&, std::ostream&);
+
+#endif  // TRACER_TIMELINE_HPP
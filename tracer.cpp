@@ -20,15 +20,36 @@
 
 #include "tracer.hpp"
 
+#include "batch.hpp"
+#include "blocks.hpp"
+#include "checkpoint.hpp"
+#include "corpus.hpp"
+#include "diff.hpp"
+#include "gather.hpp"
+#include "io.hpp"
+#include "ring.hpp"
+#include "timeline.hpp"
+#include "zone.hpp"
+
 #include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <cassert>
 #include <cctype>
+#include <csignal>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
@@ -89,10 +110,87 @@ inline std::istream& skip_spaces(std::istream& is)
     return is;
 }
 
+/** Takes the next line and checks that it is a (terminating) dot. */
+static bool read_dot(line_index_t& lines)
+{
+    auto line = std::string_view{};
+    return lines.next_line(line) && line == ".";
+}
+
+/** Parses a comma separated list of layout indices. */
+static void parse_cells(const std::string& str, std::vector<int>& cells)
+{
+    for (size_t pos = 0, end; pos < str.size(); pos = end + 1) {
+        end = std::min(str.find(',', pos), str.size());
+        cells.push_back(std::stoi(str.substr(pos, end - pos)));
+    }
+}
+
+/** Bytecode opcodes of the intermediate format decoded by the dependency analysis. */
+enum opcode_t : int { op_push = 0, op_loadL = 3, op_storeI = 24, op_cexpri = 42, op_halt = 47 };
+
+/** Adds the layout cells stored to by the instructions from the address until halt.
+ * Decoding stops at an opcode of unknown length, the expression columns cover the rest. */
+static void decode_writes(const std::vector<int>& instructions, int address, std::vector<int>& cells)
+{
+    for (auto pc = static_cast<size_t>(address); pc < instructions.size();) {
+        switch (instructions[pc]) {
+        case op_push:
+        case op_loadL: pc += 2; break;
+        case op_storeI:
+            if (pc + 1 < instructions.size())
+                cells.push_back(instructions[pc + 1]);
+            pc += 3;
+            break;
+        case op_cexpri: pc += 4; break;
+        case op_halt:
+        default: return;
+        }
+    }
+}
+
+/** Computes the integers read and written by each edge from the expressions and their bytecode. */
+static void analyse_edges(model_t& model, const std::map<int, std::vector<int>>& reads,
+                          const std::map<int, std::vector<int>>& writes)
+{
+    auto count = 0;
+    model.variables.assign(model.layout.size(), -1);
+    for (size_t i = 0; i < model.layout.size(); ++i) {
+        const auto& data = model.layout[i].data;
+        if (std::holds_alternative<cell_t::integer_t>(data) || std::holds_alternative<cell_t::meta_t>(data))
+            model.variables[i] = count++;
+    }
+    auto to_integers = [&model](const std::vector<int>& cells, std::vector<int>& res) {
+        res.clear();
+        for (auto c : cells)
+            if (0 <= c && c < (int)model.variables.size() && model.variables[c] != -1)
+                res.push_back(model.variables[c]);
+        std::sort(res.begin(), res.end());
+        res.erase(std::unique(res.begin(), res.end()), res.end());
+    };
+    auto cells = std::vector<int>{};
+    for (auto& edge : model.edges) {
+        cells.clear();
+        for (auto expr : {edge.guard, edge.sync, edge.update})
+            if (auto it = reads.find(expr); it != reads.end())
+                cells.insert(cells.end(), it->second.begin(), it->second.end());
+        to_integers(cells, edge.reads);
+        cells.clear();
+        for (auto expr : {edge.guard, edge.sync, edge.update})
+            if (auto it = writes.find(expr); it != writes.end())
+                cells.insert(cells.end(), it->second.begin(), it->second.end());
+        if (edge.update >= 0)
+            decode_writes(model.instructions, edge.update, cells);
+        to_integers(cells, edge.writes);
+    }
+}
+
 /** Parses intermediate format. */
 std::istream& model_t::read(std::istream& is)
 {
     clear();
+    auto reads = std::map<int, std::vector<int>>{};   // expression index -> layout cells read
+    auto writes = std::map<int, std::vector<int>>{};  // expression index -> layout cells written
     std::string str;
     std::string section;
     int index;
@@ -215,12 +313,20 @@ std::istream& model_t::read(std::istream& is)
                     throw invalid_format("In expression section");
 
                 // Find expression string (after the third colon).
+                size_t colons[3];
                 auto pos = str.find_first_of(':');
                 auto count = 0u;
-                while (pos != str.npos && ++count < 3)
+                while (pos != str.npos && ++count < 3) {
+                    colons[count - 1] = pos;
                     pos = str.find_first_of(':', pos + 1);
+                }
                 if (pos == str.npos || count != 3)
                     throw invalid_format("Missing colon in expression section");
+                colons[2] = pos;
+
+                // Layout cells read and written are listed between the colons.
+                parse_cells(str.substr(colons[0] + 1, colons[1] - colons[0] - 1), reads[index]);
+                parse_cells(str.substr(colons[1] + 1, colons[2] - colons[1] - 1), writes[index]);
 
                 // Trim white space.
                 pos = str.find_first_not_of(" \r\n\t\v", pos + 1);
@@ -231,6 +337,7 @@ std::istream& model_t::read(std::istream& is)
             throw invalid_format("Unknown section");
         }
     }
+    analyse_edges(*this, reads, writes);
     return is;
 }
 
@@ -282,14 +389,46 @@ std::istream& State::read(const model_t& model, std::istream& is)
     return is >> read_dot;
 }
 
+bool State::read(const model_t& model, line_index_t& lines)
+{
+    auto line = std::string_view{};
+    locations.resize(model.processes.size());
+    if (!lines.next_line(line) || !parse_ints(line, locations.data(), locations.size()) || !read_dot(lines))
+        return false;
+
+    const auto clock_count = model.clocks.size();
+    dbm.assign(clock_count * clock_count, infinity);
+    for (size_t i = 0; i < clock_count; ++i) {
+        set_bound(clock_count, 0, i, zero);
+        set_bound(clock_count, i, i, zero);
+    }
+    while (true) {
+        if (!lines.next_line(line))
+            return false;
+        if (line == ".")
+            break;
+        int b[3];  // i, j, bnd
+        if (!parse_ints(line, b, 3) || b[0] < 0 || static_cast<size_t>(b[0]) >= clock_count || b[1] < 0 ||
+            static_cast<size_t>(b[1]) >= clock_count || !read_dot(lines))
+            return false;
+        set_bound(clock_count, b[0], b[1], {b[2] >> 1, ((b[2] & 1) != 0)});
+    }
+
+    integers.resize(model.integers.size());
+    return lines.next_line(line) && parse_ints(line, integers.data(), integers.size()) && read_dot(lines);
+}
+
 /** Output operator for a symbolic state. Prints the location vector,
  * the integers and the zone of the symbolic state.
  */
-std::ostream& State::print(const model_t& model, std::ostream& os) const
+std::ostream& State::print(const model_t& model, std::ostream& os, const state_view_t& view) const
 {
     // Print location vector.
     assert(model.processes.size() == locations.size());
+    assert(view.processes.empty() || view.processes.size() == locations.size());
     for (size_t p = 0; p < model.processes.size(); ++p) {
+        if (!view.processes.empty() && !view.processes[p])
+            continue;
         const auto& proc = model.processes[p];
         int idx = proc.locations[locations[p]];
         os << proc.name << '.' << model.layout[idx].name << " ";
@@ -297,15 +436,33 @@ std::ostream& State::print(const model_t& model, std::ostream& os) const
 
     // Print integers.
     assert(model.integers.size() == integers.size());
+    assert(view.integers.empty() || view.integers.size() == integers.size());
     for (size_t v = 0; v < model.integers.size(); ++v)
-        os << model.integers[v] << "=" << integers[v] << ' ';
+        if (view.integers.empty() || view.integers[v])
+            os << model.integers[v] << "=" << integers[v] << ' ';
 
     // Print clocks.
     const auto clock_count = model.clocks.size();
     assert(dbm.size() == clock_count * clock_count);
+    // The reference clock #t(0) stays: the differences with it are the bounds of the other clocks.
+    auto hidden = [&](size_t c) { return !view.internal_clocks && c != 0 && model.clocks[c][0] == '#'; };
+    if (view.intervals) {
+        thread_local auto lower = std::vector<bound_t>{}, upper = std::vector<bound_t>{};
+        clock_bounds(clock_count, lower, upper);
+        for (size_t c = 1; c < clock_count; ++c) {
+            if (hidden(c))
+                continue;
+            os << model.clocks[c] << '=' << (lower[c].strict ? '(' : '[') << -lower[c].value << ',';
+            if (upper[c].value == infinity.value)
+                os << "inf) ";
+            else
+                os << upper[c].value << (upper[c].strict ? ") " : "] ");
+        }
+        return os;
+    }
     for (size_t i = 0; i < clock_count; i++) {
         for (size_t j = 0; j < clock_count; j++) {
-            if (i != j) {
+            if (i != j && !hidden(i) && !hidden(j)) {
                 const bound_t& bnd = get_bound(clock_count, i, j);
                 if (bnd.value != infinity.value)
                     os << model.clocks[i] << "-" << model.clocks[j] << (bnd.strict ? "<" : "<=") << bnd.value << " ";
@@ -316,6 +473,67 @@ std::ostream& State::print(const model_t& model, std::ostream& os) const
     return os;
 }
 
+void State::clock_bounds(size_t clock_count, std::vector<bound_t>& lower, std::vector<bound_t>& upper) const
+{
+    // Shortest paths from and to the reference clock (Bellman-Ford) over the finite bounds:
+    // traces store DBMs reduced to a few bounds, so this is cheaper than closing the whole DBM.
+    struct edge_t
+    {
+        uint32_t from, to;
+        int32_t bound;  ///< encoded as in zone_t
+    };
+    thread_local auto edges = std::vector<edge_t>{};
+    edges.clear();
+    for (size_t i = 0; i < clock_count; ++i)
+        for (size_t j = 0; j < clock_count; ++j)
+            if (const auto& b = get_bound(clock_count, i, j); i != j && b.value != infinity.value)
+                edges.push_back({uint32_t(i), uint32_t(j), zone_t::encode(b)});
+    thread_local auto from = std::vector<int32_t>{}, to = std::vector<int32_t>{};
+    from.assign(clock_count, zone_t::unbounded);
+    to.assign(clock_count, zone_t::unbounded);
+    from[0] = to[0] = zone_t::encode(zero);
+    for (size_t round = 0; round < clock_count; ++round) {
+        auto changed = false;
+        for (const auto& e : edges) {
+            if (const auto d = add_bounds(from[e.from], e.bound); d < from[e.to]) {
+                from[e.to] = d;
+                changed = true;
+            }
+            if (const auto d = add_bounds(e.bound, to[e.to]); d < to[e.from]) {
+                to[e.from] = d;
+                changed = true;
+            }
+        }
+        if (!changed)
+            break;
+    }
+    lower.resize(clock_count);
+    upper.resize(clock_count);
+    std::transform(from.begin(), from.end(), lower.begin(), &zone_t::decode);
+    std::transform(to.begin(), to.end(), upper.begin(), &zone_t::decode);
+}
+
+std::ostream& State::write(const model_t& model, std::ostream& os) const
+{
+    for (auto l : locations)
+        os << l << ' ';
+    os << "\n.\n";
+    // Only the bounds differing from the defaults assumed by State::read are written.
+    const auto clock_count = model.clocks.size();
+    for (size_t i = 0; i < clock_count; ++i) {
+        for (size_t j = 0; j < clock_count; ++j) {
+            const auto& bnd = get_bound(clock_count, i, j);
+            const auto& implicit = (i == 0 || i == j) ? zero : infinity;
+            if (bnd.value != implicit.value || bnd.strict != implicit.strict)
+                os << i << ' ' << j << ' ' << (bnd.value * 2 + bnd.strict) << "\n.\n";
+        }
+    }
+    os << ".\n";
+    for (auto v : integers)
+        os << v << ' ';
+    return os << "\n.\n";
+}
+
 std::istream& Transition::read(const model_t& model, std::istream& is)
 {
     edges.clear();
@@ -338,6 +556,35 @@ std::istream& Transition::read(const model_t& model, std::istream& is)
     return is >> read_dot;
 }
 
+bool Transition::read(const model_t&, line_index_t& lines)
+{
+    auto line = std::string_view{};
+    if (!lines.next_line(line))
+        return false;
+    edges.clear();
+    const auto* end = line.data() + line.size();
+    auto* p = skip_spaces(line.data(), end);
+    while (p != end && *p != '.') {
+        auto e = Edge{};
+        auto r = std::from_chars(p, end, e.process);
+        if (r.ec != std::errc{})
+            return false;
+        r = std::from_chars(skip_spaces(r.ptr, end), end, e.edge);
+        if (r.ec != std::errc{})
+            return false;
+        for (p = skip_spaces(r.ptr, end); p != end && *p != ';'; p = skip_spaces(r.ptr, end)) {
+            r = std::from_chars(p, end, e.select.emplace_back());
+            if (r.ec != std::errc{})
+                return false;
+        }
+        if (p == end)
+            return false;  // old format or truncated
+        p = skip_spaces(p + 1, end);
+        edges.push_back(std::move(e));
+    }
+    return p != end && skip_spaces(p + 1, end) == end;
+}
+
 /** Prints all edges in the transition including the source, destination, guard,
  * synchronisation and assignment. */
 std::ostream& Transition::print(const model_t& model, std::ostream& os) const
@@ -366,76 +613,1269 @@ std::ostream& Transition::print(const model_t& model, std::ostream& os) const
     return os;
 }
 
+std::ostream& Transition::write(const model_t&, std::ostream& os) const
+{
+    for (const auto& e : edges) {
+        os << e.process << ' ' << e.edge << ' ';
+        for (auto v : e.select)
+            os << v << ' ';
+        os << "; ";
+    }
+    return os << ".\n";
+}
+
+trace_slice_t::trace_slice_t(const model_t& model, const std::string& names)
+{
+    for (auto begin = size_t{0}, end = size_t{0}; begin <= names.size(); begin = end + 1) {
+        end = std::min(names.find(',', begin), names.size());
+        const auto name = names.substr(begin, end - begin);
+        const auto process = std::find_if(model.processes.begin(), model.processes.end(),
+                                          [&name](const process_t& p) { return p.name == name; });
+        const auto integer = std::find(model.integers.begin(), model.integers.end(), name);
+        if (process != model.processes.end()) {
+            processes.resize(model.processes.size(), false);
+            processes[process - model.processes.begin()] = true;
+        } else if (integer != model.integers.end()) {
+            integers.resize(model.integers.size(), false);
+            integers[integer - model.integers.begin()] = true;
+        } else {
+            throw std::invalid_argument{"unknown process or variable: \"" + name + "\""};
+        }
+    }
+}
+
+bool trace_slice_t::involves(const model_t& model, const Transition& transition) const
+{
+    return std::any_of(transition.edges.begin(), transition.edges.end(), [&](const Edge& e) {
+        if (!processes.empty() && processes[e.process])
+            return true;
+        if (integers.empty())
+            return false;
+        const auto& writes = model.edges[model.processes[e.process].edges[e.edge]].writes;
+        return std::any_of(writes.begin(), writes.end(), [this](int v) { return integers[v]; });
+    });
+}
+
+trace_reader_t::trace_reader_t(const model_t& model, std::istream& is):
+    model{model}, is{is}, buffer{dynamic_cast<window_buffer_t*>(is.rdbuf())}
+{}
+
+template <typename Parse>
+bool trace_reader_t::read_lines(Parse&& parse)
+{
+    if (buffer == nullptr)
+        return false;
+    const auto window = buffer->window();
+    lines.seek(window.begin, window.end, window.fill);
+    if (!parse()) {
+        if (!lines.exhausted())
+            buffer = nullptr;  // not in the current format: parse the rest from the stream
+        return false;
+    }
+    buffer->consume(lines.position() - window.begin);
+    return true;
+}
+
+std::istream& trace_reader_t::read_initial(State& state)
+{
+    if (!read_lines([&] { return state.read(model, lines); }))
+        state.read(model, is);
+    return is;
+}
+
+bool trace_reader_t::next(Successor& step)
+{
+    // Skip white space.
+    is >> skip_spaces;
+
+    // A dot terminates the trace.
+    if (is.peek() == '.') {
+        is.get();
+        return false;
+    }
+
+    // Read a state and a transition.
+    if (!read_lines([&] { return step.state.read(model, lines) && step.transition.read(model, lines); })) {
+        step.state.read(model, is);
+        step.transition.read(model, is);
+    }
+    return true;
+}
+
 std::istream& trace_t::read(const model_t& model, std::istream& is)
 {
+    store.clear();
     steps.clear();
-    initial.read(model, is);
-    for (;;) {
-        // Skip white space.
-        is >> skip_spaces;
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    initial = store.intern(step.state);
+    while (reader.next(step))
+        steps.push_back(store.intern(step));
+    return is;
+}
+
+std::optional<lasso_t> find_lasso(const model_t& model, std::istream& is)
+{
+    auto store = state_store_t{};
+    auto seen = std::unordered_map<state_id_t, size_t>{};
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    seen.emplace(store.intern(step.state), 0);
+    for (auto n = size_t{1}; reader.next(step); ++n)
+        if (auto [it, inserted] = seen.emplace(store.intern(step.state), n); !inserted)
+            return lasso_t{it->second, n};
+    return std::nullopt;
+}
+
+trace_t read_without_cycles(const model_t& model, std::istream& is, size_t max_memory)
+{
+    auto trace = trace_t{};
+    trace.steps = step_list_t{max_memory};
+    auto index = std::unordered_map<state_id_t, size_t>{};  // state -> number of kept steps leading to it
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    trace.initial = trace.store.intern(step.state);
+    index.emplace(trace.initial, 0);
+    auto pending = std::optional<step_id_t>{};  // the last step read is kept even if it closes a cycle
+    while (reader.next(step)) {
+        if (pending) {
+            if (auto it = index.find(pending->state); it != index.end()) {
+                // Cut the cycle returning to the state.
+                const auto keep = it->second;
+                for (auto i = keep; i < trace.steps.size(); ++i)
+                    index.erase(trace.steps[i].state);
+                trace.steps.resize(keep);
+            } else {
+                index.emplace(pending->state, trace.steps.size() + 1);
+                trace.steps.push_back(*pending);
+            }
+        }
+        pending = trace.store.intern(step);
+    }
+    if (pending)
+        trace.steps.push_back(*pending);
+    return trace;
+}
+
+std::ostream& Successor::print(const model_t& model, std::ostream& os, const state_view_t& view) const
+{
+    transition.print(model, os << "\nTransition: ") << '\n';
+    return state.print(model, os << "\nState: ", view) << '\n';
+}
+
+std::ostream& trace_t::print(const model_t& model, std::ostream& os, const state_view_t& view) const
+{
+    auto step = Successor{};
+    store.load(initial, step.state);
+    step.state.print(model, os << "State: ", view) << '\n';
+    for (auto i = size_t{0}; i < steps.size(); ++i) {
+        store.load(steps[i], step);
+        step.print(model, os, view);
+    }
+    return os << std::flush;
+}
+
+/** Options for printing the trace. */
+struct print_options_t
+{
+    size_t limit{std::numeric_limits<size_t>::max()};  ///< maximum number of steps to read
+    size_t sample{1};                                  ///< print every sample-th step
+    size_t tail{std::numeric_limits<size_t>::max()};   ///< print only the last steps
+    bool reverse{false};                               ///< print the steps from the last to the first
+    state_view_t view;                                 ///< what to show of the states
+    std::optional<trace_slice_t> slice;                ///< print only the steps involving these processes/variables
+    bool xtr{false};                                   ///< write the trace in the xtr format instead of text
+    std::optional<std::pair<int32_t, int32_t>> window;  ///< print only the states within the #time interval
+    std::string checkpoint;                            ///< file to save the progress to, none if empty
+    size_t checkpoint_steps{1000000};                  ///< steps between checkpoints
+    checkpoint_t progress;                             ///< the trace and settings, and the progress to resume
+    bool resume{false};                                ///< continue after the progress instead of the beginning
+    size_t max_memory{step_list_t::unlimited};         ///< bytes of stored steps kept in memory, the rest is spilled
+    bool gather{false};                                ///< print the text to the standard output file with writev
+};
 
-        // A dot terminates the trace.
-        if (is.peek() == '.') {
-            is.get();
+/** Reads and prints the trace step by step, sliced onto the processes if requested.
+ * Stops as soon as the output is closed (e.g. by a pager or head) or the step limit is reached.
+ * The xtr output is a valid trace over the same model even if it was cut short.
+ * With a checkpoint file the progress is saved periodically, and printing continues after the saved step
+ * if the input has been positioned there for resuming.
+ * @returns true if the whole trace was read. */
+static bool print_trace(const model_t& model, std::istream& is, std::ostream& os, const print_options_t& options)
+{
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    auto progress = options.progress;
+    auto gather = std::unique_ptr<gather_printer_t>{};
+    if (options.gather && !options.xtr) {
+        os.flush();
+        std::fflush(stdout);
+        gather = std::make_unique<gather_printer_t>(model, fileno(stdout), options.view);
+    }
+    auto good = [&] { return gather ? gather->good() : !os.fail(); };
+    // The steps read so far are shown while a pipe is waiting for the next ones.
+    auto* input = dynamic_cast<input_buffer_t*>(is.rdbuf());
+    if (input != nullptr)
+        input->on_wait([&] {
+            if (gather)
+                gather->flush();
+            os.flush();
+        });
+    if (options.resume) {
+        step.state = std::move(progress.state);
+    } else {
+        reader.read_initial(step.state);
+        if (options.xtr)
+            step.state.write(model, os);
+        else if (gather)
+            gather->initial(step.state);
+        else
+            step.state.print(model, os << "State: ", options.view) << '\n';
+    }
+    auto complete = false;
+    for (auto n = progress.step + 1, kept = progress.kept; good() && n <= options.limit; ++n) {
+        if (!reader.next(step)) {
+            complete = true;
             break;
         }
+        if ((!options.slice || options.slice->involves(model, step.transition)) && ++kept % options.sample == 0) {
+            if (options.xtr) {
+                step.state.write(model, os);
+                step.transition.write(model, os);
+            } else if (gather) {
+                gather->step(step);
+            } else {
+                step.transition.print(model, os << "\nTransition: ") << '\n';
+                step.state.print(model, os << "\nState: ", options.view) << '\n';
+            }
+        }
+        if (!options.checkpoint.empty() && n % options.checkpoint_steps == 0 && (!gather || gather->flush()) &&
+            good()) {
+            progress.offset = is.tellg();
+            progress.step = n;
+            progress.kept = kept;
+            progress.output = output_position();
+            progress.state = step.state;
+            progress.save(model, options.checkpoint);
+        }
+    }
+    if (options.xtr)
+        os << ".\n";
+    if (gather)
+        gather->flush();
+    os.flush();
+    if (input != nullptr)
+        input->on_wait(nullptr);
+    return complete;
+}
 
-        // Read a state and a transition.
-        auto state = State{};
-        state.read(model, is);
-        auto transition = Transition{};
-        transition.read(model, is);
-        steps.emplace_back(std::move(transition), std::move(state));
+/** Publishes the initial state and every sampled step into the shared-memory ring for local viewers.
+ * @returns true if the whole trace was read. */
+static bool publish_trace(const model_t& model, std::istream& is, ring_writer_t& ring, const print_options_t& options)
+{
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    ring.write(0, nullptr, step.state);
+    auto complete = false;
+    for (auto n = size_t{1}; n <= options.limit; ++n) {
+        if (!reader.next(step)) {
+            complete = true;
+            break;
+        }
+        if (n % options.sample == 0)
+            ring.write(n, &step.transition, step.state);
     }
-    return is;
+    ring.close();
+    return complete;
 }
 
-std::ostream& trace_t::print(const model_t& model, std::ostream& os) const
+/** Renders the trace into compressed blocks of steps.
+ * @returns true if the whole trace was read. */
+static bool write_blocks(const model_t& model, std::istream& is, block_writer_t& blocks,
+                         const print_options_t& options)
 {
-    os << "State: ";
-    initial.print(model, os) << endl;
-    for (const auto& step : steps) {
-        step.transition.print(model, os << "\nTransition: ") << endl;
-        step.state.print(model, os << "\nState: ") << endl;
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    reader.read_initial(step.state);
+    step.state.print(model, blocks.step() << "State: ", options.view) << '\n';
+    blocks.end_step();
+    auto complete = false;
+    for (size_t n = 1; n <= options.limit; ++n) {
+        if (!reader.next(step)) {
+            complete = true;
+            break;
+        }
+        step.print(model, blocks.step(), options.view);
+        blocks.end_step();
     }
-    return os;
+    blocks.finish();
+    return complete;
+}
+
+/** Prints the steps whose #time interval intersects the time window, using an index of the time intervals.
+ * The trace is read only until the states start after the window.
+ * @returns true if the whole trace was read. */
+static bool print_time_window(const model_t& model, std::istream& is, std::ostream& os,
+                              const print_options_t& options)
+{
+    const auto time = std::find(model.clocks.begin(), model.clocks.end(), "#time");
+    if (time == model.clocks.end())
+        throw std::invalid_argument{"the model has no #time clock"};
+    const auto clock = static_cast<size_t>(time - model.clocks.begin());
+    const auto [from, to] = *options.window;
+    auto trace = trace_t{};
+    trace.steps = step_list_t{options.max_memory};
+    auto index = time_index_t{};
+    auto zones = std::unordered_map<uint32_t, zone_t>{};  // closed zones of distinct DBMs
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    auto add = [&](const State& state, state_id_t id) {
+        auto [it, inserted] = zones.try_emplace(id.dbm);
+        if (inserted)
+            it->second = zone_t{state, model.clocks.size()};
+        index.push_back(it->second, clock);
+    };
+    reader.read_initial(step.state);
+    trace.initial = trace.store.intern(step.state);
+    add(step.state, trace.initial);
+    auto complete = true;
+    for (auto n = size_t{1}; index.starts_before(n - 1, to); ++n) {
+        if (n > options.limit) {
+            complete = false;
+            break;
+        }
+        if (!reader.next(step))
+            break;
+        trace.steps.push_back(trace.store.intern(step));
+        add(step.state, trace.steps.back().state);
+    }
+    if (!index.starts_before(index.size() - 1, to))
+        complete = false;  // the time of the following states does not decrease
+    index.build();
+    auto state = State{};
+    for (auto i : index.find(from, to)) {
+        if (!os)
+            break;
+        if (i == 0) {
+            trace.store.load(trace.initial, state);
+            state.print(model, os << "State: ", options.view) << '\n';
+        } else {
+            trace.store.load(trace.steps[i - 1], step);
+            step.print(model, os, options.view);
+        }
+    }
+    os.flush();
+    return complete;
+}
+
+/** Prints the state followed by the steps (or the last step first if reversed). */
+static void print_window(const model_t& model, const State& before, const std::deque<Successor>& steps,
+                         std::ostream& os, const print_options_t& options)
+{
+    if (!options.reverse) {
+        before.print(model, os << "State: ", options.view) << '\n';
+        auto n = size_t{0};
+        for (const auto& step : steps)
+            if (++n > options.limit || !os)
+                break;
+            else if (n % options.sample == 0)
+                step.print(model, os, options.view);
+    } else {
+        // Each transition is followed by its source state.
+        auto it = steps.rbegin();
+        if (it == steps.rend())
+            before.print(model, os << "State: ", options.view) << '\n';
+        else
+            it->state.print(model, os << "State: ", options.view) << '\n';
+        for (auto n = size_t{1}; it != steps.rend() && n <= options.limit && os; ++it, ++n) {
+            if (n % options.sample != 0)
+                continue;
+            const auto next = std::next(it);
+            const auto& source = next == steps.rend() ? before : next->state;
+            it->transition.print(model, os << "\nTransition: ") << '\n';
+            source.print(model, os << "\nState: ", options.view) << '\n';
+        }
+    }
+    os.flush();
+}
+
+/** Prints the stored trace from the first step to the last. */
+static void print_forward(const model_t& model, const trace_t& trace, std::ostream& os,
+                          const print_options_t& options)
+{
+    auto step = Successor{};
+    trace.store.load(trace.initial, step.state);
+    step.state.print(model, os << "State: ", options.view) << '\n';
+    for (auto n = size_t{1}; n <= trace.steps.size() && n <= options.limit && os; ++n) {
+        if (n % options.sample != 0)
+            continue;
+        trace.store.load(trace.steps[n - 1], step);
+        step.print(model, os, options.view);
+    }
+    os.flush();
+}
+
+/** Prints the stored trace from the last step to the first. */
+static void print_reverse(const model_t& model, const trace_t& trace, std::ostream& os,
+                          const print_options_t& options)
+{
+    auto state = State{};
+    auto transition = Transition{};
+    trace.store.load(trace.steps.empty() ? trace.initial : trace.steps.back().state, state);
+    state.print(model, os << "State: ", options.view) << '\n';
+    for (auto i = trace.steps.size(), n = size_t{1}; i > 0 && n <= options.limit && os; --i, ++n) {
+        if (n % options.sample != 0)
+            continue;
+        trace.store.load(trace.steps[i - 1].transition, transition);
+        trace.store.load(i > 1 ? trace.steps[i - 2].state : trace.initial, state);
+        transition.print(model, os << "\nTransition: ") << '\n';
+        state.print(model, os << "\nState: ", options.view) << '\n';
+    }
+    os.flush();
+}
+
+/** Prints the last steps of the trace stream (or the whole trace reversed),
+ * keeping at most options.tail steps in memory. */
+static void print_tail(const model_t& model, std::istream& is, std::ostream& os, const print_options_t& options)
+{
+    if (options.tail == std::numeric_limits<size_t>::max()) {
+        // The whole trace is needed: keep its states hash-consed.
+        auto trace = trace_t{};
+        trace.steps = step_list_t{options.max_memory};
+        trace.read(model, is);
+        print_reverse(model, trace, os, options);
+        return;
+    }
+    auto reader = trace_reader_t{model, is};
+    auto before = State{};
+    auto steps = std::deque<Successor>{};
+    auto step = Successor{};
+    reader.read_initial(before);
+    while (reader.next(step)) {
+        if (steps.size() == options.tail) {
+            before = std::move(steps.front().state);
+            steps.pop_front();
+        }
+        steps.push_back(std::move(step));
+    }
+    print_window(model, before, steps, os, options);
+}
+
+/** Finds the end of the trace text: the start of the terminating dot line.
+ * @returns nullptr unless the trace is in the current format where transition lines end with "; ." */
+static const char* trace_end(const char* begin, const char* end)
+{
+    auto* p = end;
+    while (p > begin && isspace(p[-1]))
+        --p;
+    if (p == begin || *--p != '.' || (p > begin && p[-1] != '\n'))
+        return nullptr;
+    auto* last = p;  // the terminating dot
+    if (p > begin)
+        --p;  // the newline of the last transition line
+    while (p > begin && p[-1] != '\n')
+        --p;
+    if (std::find(p, last, ';') == last)
+        return nullptr;  // empty trace or old format without ';' terminated edges
+    return last;
+}
+
+/** Finds the start of the step preceding the step boundary by scanning backwards.
+ * Relies on transition lines being the only lines containing ';'.
+ * @returns the start of the previous step or begin if it is the first step (preceded by the initial state). */
+static const char* previous_step(const char* begin, const char* boundary)
+{
+    // Skip the transition line of the previous step.
+    auto* p = boundary;
+    if (p > begin)
+        --p;
+    while (p > begin && p[-1] != '\n')
+        --p;
+    // The last ';' before belongs to the transition of the step before the previous one.
+    while (p > begin && *--p != ';')
+        ;
+    if (*p != ';')
+        return begin;
+    return static_cast<const char*>(memchr(p, '\n', boundary - p)) + 1;
+}
+
+/** Parses the step starting at the position, the initial state is stored into before if the step is the first one. */
+static void read_step(const model_t& model, const char* begin, const char* pos, const char* end, State& before,
+                      Successor& step)
+{
+    auto is = memory_stream_t{pos, end};
+    auto reader = trace_reader_t{model, is};
+    if (pos == begin)
+        reader.read_initial(before);
+    if (!reader.next(step))
+        throw invalid_format{"Expecting a step but got the end of trace"};
+}
+
+/** Prints the last steps of the trace (or the whole trace reversed) from memory,
+ * locating the steps by scanning backwards from the end, so that the cost is proportional to the printed steps.
+ * @returns false if the trace is not in the format suitable for backward scanning. */
+static bool print_tail(const model_t& model, const mapped_file_t& file, std::ostream& os,
+                       const print_options_t& options)
+{
+    const auto* begin = file.begin();
+    const auto* end = trace_end(begin, file.end());
+    if (end == nullptr)
+        return false;
+    const auto* pos = end;
+    auto before = State{};
+    if (!options.reverse) {
+        // Locate the last steps and the one before them holding the starting state.
+        auto count = size_t{0};
+        while (pos != begin && count <= options.tail) {
+            pos = previous_step(begin, pos);
+            ++count;
+        }
+        auto is = memory_stream_t{pos, end + 1};
+        auto reader = trace_reader_t{model, is};
+        auto steps = std::deque<Successor>{};
+        auto step = Successor{};
+        if (pos == begin)
+            reader.read_initial(before);
+        else if (reader.next(step))
+            before = std::move(step.state);
+        while (reader.next(step))
+            steps.push_back(std::move(step));
+        print_window(model, before, steps, os, options);
+        return true;
+    }
+    // Reversed: parse one step at a time walking backwards.
+    auto step = Successor{};
+    auto next = previous_step(begin, pos);
+    read_step(model, begin, next, pos, before, step);
+    step.state.print(model, os << "State: ", options.view) << '\n';
+    for (auto n = size_t{1}; n <= options.tail && n <= options.limit && os; ++n) {
+        auto transition = std::move(step.transition);
+        pos = next;
+        if (pos == begin)
+            step.state = before;
+        else {
+            next = previous_step(begin, pos);
+            read_step(model, begin, next, pos, before, step);
+        }
+        if (n % options.sample == 0) {
+            transition.print(model, os << "\nTransition: ") << '\n';
+            step.state.print(model, os << "\nState: ", options.view) << '\n';
+        }
+        if (pos == begin)
+            break;
+    }
+    os.flush();
+    return true;
+}
+
+/** Parses a positive number for the option. */
+static size_t parse_count(const std::string& option, const std::string& value, bool positive = true)
+{
+    auto pos = size_t{0};
+    auto res = 0ul;
+    try {
+        res = std::stoul(value, &pos);
+    } catch (std::exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != value.size() || (positive && res == 0) || value[0] == '-')
+        throw std::invalid_argument{option + " expects a " + (positive ? "positive " : "") + "number, got \"" +
+                                    value + "\""};
+    return res;
+}
+
+/** Parses a memory size: a number of bytes optionally followed by K, M or G. */
+static size_t parse_memory_size(const std::string& option, const std::string& value)
+{
+    auto pos = size_t{0};
+    auto res = 0ull;
+    try {
+        res = std::stoull(value, &pos);
+    } catch (std::exception&) {
+        pos = 0;
+    }
+    auto shift = 0;
+    if (pos != 0 && pos + 1 == value.size()) {
+        switch (std::toupper(static_cast<unsigned char>(value[pos]))) {
+        case 'K': shift = 10, ++pos; break;
+        case 'M': shift = 20, ++pos; break;
+        case 'G': shift = 30, ++pos; break;
+        }
+    }
+    if (pos == 0 || pos != value.size() || res == 0 || value[0] == '-' ||
+        res > (std::numeric_limits<size_t>::max() >> shift))
+        throw std::invalid_argument{option + " expects a size like 512M, got \"" + value + "\""};
+    return static_cast<size_t>(res) << shift;
+}
+
+/** Parses the time window "from:to", either end may be omitted. */
+static std::pair<int32_t, int32_t> parse_window(const std::string& option, const std::string& value)
+{
+    constexpr auto max = int32_t{1} << 29;  // leaves room for the encoded bound arithmetic
+    auto parse = [&](const std::string& str, int32_t dflt) {
+        if (str.empty())
+            return dflt;
+        auto pos = size_t{0};
+        auto res = 0l;
+        try {
+            res = std::stol(str, &pos);
+        } catch (std::exception&) {
+            pos = 0;
+        }
+        if (pos == 0 || pos != str.size() || res < -max || res > max)
+            throw std::invalid_argument{option + " expects from:to time bounds, got \"" + value + "\""};
+        return static_cast<int32_t>(res);
+    };
+    const auto colon = value.find(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument{option + " expects from:to time bounds, got \"" + value + "\""};
+    return {parse(value.substr(0, colon), 0), parse(value.substr(colon + 1), max)};
+}
+
+/** Identifies the trace and the printing options for the checkpoints, and positions the input after the saved
+ * checkpoint (and the output after what was printed until then) if the run is resumed.
+ * Exits upon a checkpoint of another trace or other options. */
+static void prepare_checkpoint(const model_t& model, const std::string& path, std::istream& trace,
+                               print_options_t& options, const std::string& slice)
+{
+    if (dynamic_cast<input_buffer_t*>(trace.rdbuf()) == nullptr) {
+        std::cerr << "--checkpoint requires an uncompressed trace file" << endl;
+        std::exit(EXIT_FAILURE);
+    }
+    auto& progress = options.progress;
+    progress.identify(path);
+    auto settings = std::ostringstream{};
+    settings << "sample=" << options.sample << " xtr=" << options.xtr << " intervals=" << options.view.intervals
+             << " internal=" << options.view.internal_clocks << " slice=" << slice;
+    progress.settings = settings.str();
+    auto saved = checkpoint_t{};
+    if (!options.resume || !saved.load(model, options.checkpoint)) {
+        options.resume = false;  // nothing to resume
+        return;
+    }
+    if (!saved.same_trace(progress)) {
+        std::cerr << options.checkpoint << ": the trace has changed since the checkpoint" << endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (saved.settings != progress.settings) {
+        std::cerr << options.checkpoint << ": saved with other options (" << saved.settings << ")" << endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (!trace.seekg(saved.offset)) {
+        std::cerr << path << ": cannot seek to the checkpoint" << endl;
+        std::exit(EXIT_FAILURE);
+    }
+    truncate_output(saved.output);
+    progress = std::move(saved);
+}
+
+/** What to do with the trace. */
+enum class action_t { print, lasso, cut_cycles, gantt, publish };
+
+static void print_usage(const char* program)
+{
+    auto name = std::filesystem::path{program}.filename().string();
+    std::cerr << name
+              << " produces a human readable diagnostic trace by reading:\n"
+                 "\ta UPPAAL model file in the intermediate format (produced by "
+                 "\"UPPAAL_COMPILE_ONLY=1 verifyta model.xml\") and\n"
+                 "\ta trace file in xtr (\"dot\") format.\n"
+                 "Either file can be \"-\" to read it from the standard input (e.g. a pipe).\n"
+                 "Alternatively the model checker can be run directly on the model and the query,\n"
+                 "then the model and the first diagnostic trace are streamed without temporary files.\n";
+    std::cerr << "Synopsis:\n\t" << name << " <if-file> <xtr-trace-file>\n";
+    std::cerr << "\t" << name << " --checker <verifyta> [--checker-options <options>] <model-xml> <query-file>\n";
+    std::cerr << "\t" << name
+              << " corpus [-j <jobs>] [--divergences] [-o <file>] [--manifest <file>] [--shard <i/n>] <if-file> "
+                 "<xtr-trace-file>...\n";
+    std::cerr << "\t" << name << " diff [--max-memory <size>] <if-file> <xtr-trace-file> <xtr-trace-file>\n";
+    std::cerr << "\t" << name << " subsume <if-file> <xtr-trace-file>...\n";
+    std::cerr << "\t" << name
+              << " graph [-j <jobs>] [--format dot|binary] [-o <file>] [--manifest <file>] [--shard <i/n>] <if-file> "
+                 "<xtr-trace-file>...\n";
+    std::cerr << "\t" << name << " merge [--divergences] [--format dot|binary] [-o <file>] <if-file> <shard-file>...\n";
+    std::cerr << "\t" << name << " view [--from <step>] [--to <step>] <block-archive>\n";
+    std::cerr << "\t" << name << " follow <shm-name>\n";
+    std::cerr << "Options:\n"
+                 "\t--checker <path>          run the model checker to compile the model and produce the trace\n"
+                 "\t--checker-options <opts>  checker options for the trace generation (default \"-t0\")\n"
+                 "\t--limit <n>               stop after reading n steps\n"
+                 "\t--sample <k>              print only every k-th step\n"
+                 "\t--tail <n>                print only the last n steps\n"
+                 "\t--reverse                 print the steps from the last to the first\n"
+                 "\t--lasso                   report the stem and the loop ending at the earliest repeated state\n"
+                 "\t--cut-cycles              print the trace without cycles (except a loop closed by the last step)\n"
+                 "\t--slice <names>           print only the steps involving the comma separated processes or writing the\n"
+                 "\t                          variables, and only the locations and values of these\n"
+                 "\t--gantt csv|binary        write the stays of the processes in their locations (a Gantt timeline)\n"
+                 "\t--clock-intervals         print the lower and upper bound of each clock instead of clock differences\n"
+                 "\t--hide-internal-clocks    do not print the clocks whose names start with '#' (e.g. #time) except the\n"
+                 "\t                          reference clock #t(0) of the clock bounds (e.g. x-#t(0)<=5)\n"
+                 "\t--time-window <from:to>   print only the states whose #time interval intersects [from, to]\n"
+                 "\t--xtr                     write the (sliced, sampled or limited) trace in the xtr format\n"
+                 "\t--blocks <n>              write the text as a block archive: gzip compressed blocks of n steps\n"
+                 "\t                          with an index to view any steps quickly (see view)\n"
+                 "\t--checkpoint <file>       save the progress to the file periodically (removed when done)\n"
+                 "\t--checkpoint-steps <n>    steps between checkpoints (default 1000000)\n"
+                 "\t--resume                  continue after the saved checkpoint if any, cutting the output file back\n"
+                 "\t                          to the checkpoint (append the output with >>)\n"
+                 "\t--max-memory <size>       keep at most size bytes (suffix K, M or G) of the steps stored for\n"
+                 "\t                          --reverse, --cut-cycles, --time-window and diff in memory, spilling the\n"
+                 "\t                          rest to a temporary file\n"
+                 "\t--shm <name>              publish the steps as binary records into a shared-memory ring with the\n"
+                 "\t                          POSIX name (e.g. /tracer) for local viewers instead of printing them\n"
+                 "\t--shm-size <size>         bytes of records in the ring (default 64M)\n"
+                 "\t--shm-readers <n>         wait for n readers to attach before publishing (see follow)\n"
+                 "Corpus (merges traces into a prefix trie) and graph (merges traces into a state graph) options:\n"
+                 "\t-j <jobs>                 number of worker threads (default: all hardware threads)\n"
+                 "\t-o <file>                 output file (default: standard output)\n"
+                 "\t--divergences             print the steps where the traces continue differently\n"
+                 "\t--format dot|binary       graph format: Graphviz DOT or binary adjacency (default: dot)\n"
+                 "\t--manifest <file>         process the trace files listed in the file (one per line)\n"
+                 "\t--shard <i/n>             process the i-th of n size-balanced shards of the files and write\n"
+                 "\t                          the result for merge (default -o: <command>-<i>-of-<n>.shard)\n";
+}
+
+/** Loads the model in the intermediate format, exits upon failure to open the file. */
+static void load_model(const std::string& path, model_t& model)
+{
+    auto file = open_input(path);
+    if (!file) {
+        perror(path.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    model.read(*file);
+}
+
+/** Parses the shard "i/n" (numbered from 1) of the option. */
+static shard_header_t parse_shard(const std::string& option, const std::string& value)
+{
+    const auto slash = value.find('/');
+    auto res = shard_header_t{};
+    try {
+        if (slash == std::string::npos)
+            throw std::invalid_argument{value};
+        res.index = parse_count(option, value.substr(0, slash)) - 1;
+        res.count = parse_count(option, value.substr(slash + 1));
+    } catch (std::invalid_argument&) {
+        res.count = 0;
+    }
+    if (res.count == 0 || res.index >= res.count)
+        throw std::invalid_argument{option + " expects i/n with 1 <= i <= n, got \"" + value + "\""};
+    return res;
+}
+
+/** Processes many traces over the same model: the corpus and graph commands, and merges their shard results. */
+static int batch_main(int argc, char* args[])
+{
+    auto command = std::string{args[1]};
+    const auto merge = command == "merge";
+    auto batch = batch_t{{}, hardware_jobs()};
+    auto divergences = false;
+    auto format = std::string{"dot"};
+    auto output = std::string{};
+    auto shard = std::optional<shard_header_t>{};
+    auto manifests = std::vector<std::string>{};
+    auto files = std::vector<std::string>{};
+    for (int i = 2; i < argc; ++i) {
+        const auto arg = std::string{args[i]};
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc && !merge) {
+            batch.jobs = parse_count(arg, args[++i]);
+        } else if (arg == "--divergences" && command != "graph") {
+            divergences = true;
+        } else if (arg == "--format" && command != "corpus" && i + 1 < argc) {
+            format = args[++i];
+            if (format != "dot" && format != "binary")
+                throw std::invalid_argument{"unknown graph format: " + format};
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = args[++i];
+        } else if (arg == "--manifest" && i + 1 < argc && !merge) {
+            manifests.push_back(args[++i]);
+        } else if (arg == "--shard" && i + 1 < argc && !merge) {
+            shard = parse_shard(arg, args[++i]);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << endl;
+            print_usage(args[0]);
+            return EXIT_FAILURE;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty() || (files.size() < 2 && manifests.empty())) {
+        print_usage(args[0]);
+        return EXIT_FAILURE;
+    }
+    auto model = model_t{};
+    load_model(files[0], model);
+    batch.files.assign(files.begin() + 1, files.end());
+    for (const auto& manifest : manifests) {
+        const auto listed = read_manifest(manifest);
+        batch.files.insert(batch.files.end(), listed.begin(), listed.end());
+    }
+    if (shard) {
+        shard->kind = command == "corpus" ? shard_header_t::corpus : shard_header_t::graph;
+        batch.files = select_shard(batch.files, shard->index, shard->count);
+        if (output.empty())
+            output =
+                command + '-' + std::to_string(shard->index + 1) + "-of-" + std::to_string(shard->count) + ".shard";
+        std::cerr << "Shard " << shard->index + 1 << '/' << shard->count << ": " << batch.files.size() << " traces"
+                  << endl;
+    }
+    // Shard results to merge, all of the same command and sharding
+    auto inputs = std::vector<std::unique_ptr<std::istream>>{};
+    if (merge) {
+        auto seen = std::vector<bool>{};
+        auto first = shard_header_t{};
+        for (const auto& path : batch.files) {
+            auto& is = inputs.emplace_back(open_input(path));
+            if (!is) {
+                perror(path.c_str());
+                return EXIT_FAILURE;
+            }
+            auto header = shard_header_t{};
+            try {
+                header = read_shard_header(model, *is);
+            } catch (std::runtime_error& e) {
+                throw std::runtime_error{path + ": " + e.what()};
+            }
+            if (seen.empty()) {
+                first = header;
+                seen.resize(header.count);
+            } else if (header.kind != first.kind || header.count != first.count) {
+                throw std::runtime_error{path + ": shard result of another command or sharding"};
+            }
+            if (seen[header.index])
+                throw std::runtime_error{path + ": shard " + std::to_string(header.index + 1) + " is given twice"};
+            seen[header.index] = true;
+        }
+        for (size_t i = 0; i < seen.size(); ++i)
+            if (!seen[i])
+                throw std::runtime_error{"missing shard " + std::to_string(i + 1) + '/' + std::to_string(seen.size())};
+        command = first.kind == shard_header_t::corpus ? "corpus" : "graph";
+    }
+    auto file = std::ofstream{};
+    if (!output.empty() && output != "-") {
+        file.open(output, std::ios::binary);
+        if (!file) {
+            perror(output.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    auto& os = file.is_open() ? file : std::cout;
+    /// Reads the traces or the shard results
+    auto read = [&](auto& result) {
+        if (merge) {
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                try {
+                    result.merge(model, *inputs[i]);
+                } catch (std::runtime_error& e) {
+                    throw std::runtime_error{batch.files[i] + ": " + e.what()};
+                }
+            }
+        } else {
+            batch.run([&](size_t, std::istream& is) { result.insert(model, is); });
+        }
+    };
+    if (command == "corpus") {
+        auto trie = trace_trie_t{};
+        read(trie);
+        if (shard) {
+            trie.write_shard(write_shard_header(model, *shard, os));
+        } else {
+            trie.print_stats(os);
+            if (divergences)
+                trie.print_divergences(model, os);
+        }
+    } else {
+        auto graph = state_graph_t{};
+        read(graph);
+        if (shard)
+            graph.write_shard(write_shard_header(model, *shard, os));
+        else if (format == "dot")
+            graph.write_dot(model, os);
+        else
+            graph.write_binary(model, os);
+        std::cerr << "States: " << graph.node_count() << ", transitions: " << graph.edge_count() << endl;
+    }
+    os.flush();
+    return os ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/** Compares two traces over the same model, exits with 1 if they differ (like diff). */
+static int diff_main(int argc, char* args[])
+{
+    auto max_memory = step_list_t::unlimited;
+    auto first = 2;
+    if (argc > 3 && strcmp(args[2], "--max-memory") == 0) {
+        max_memory = parse_memory_size(args[2], args[3]);
+        first = 4;
+    }
+    if (argc != first + 3) {
+        print_usage(args[0]);
+        return 2;
+    }
+    auto model = model_t{};
+    load_model(args[first], model);
+    auto a = open_input(args[first + 1]);
+    if (!a) {
+        perror(args[first + 1]);
+        return 2;
+    }
+    auto b = open_input(args[first + 2]);
+    if (!b) {
+        perror(args[first + 2]);
+        return 2;
+    }
+    const auto stats = diff_traces(model, *a, *b, std::cout, max_memory);
+    std::cout << "Steps: " << stats.steps_a << " | " << stats.steps_b << ", aligned: " << stats.matched
+              << ", differing states: " << stats.differing << ", only in the first: " << stats.only_a
+              << ", only in the second: " << stats.only_b << endl;
+    return stats.equal() ? EXIT_SUCCESS : 1;
+}
+
+/** Reports the symbolic states subsumed by other states within one trace or across several traces. */
+static int subsume_main(int argc, char* args[])
+{
+    if (argc < 4) {
+        print_usage(args[0]);
+        return EXIT_FAILURE;
+    }
+    auto model = model_t{};
+    load_model(args[2], model);
+    auto index = subsumption_index_t{};
+    for (int i = 3; i < argc; ++i) {
+        auto trace = open_input(args[i]);
+        if (!trace) {
+            perror(args[i]);
+            return EXIT_FAILURE;
+        }
+        index.add(model, *trace);
+    }
+    const auto across = argc > 4;  // with several traces only the states of different traces are compared
+    auto pairs = std::vector<std::pair<trace_position_t, trace_position_t>>{};
+    index.for_each([&](const trace_position_t& sub, const trace_position_t& super) {
+        if (!across || sub.trace != super.trace)
+            pairs.emplace_back(sub, super);
+    });
+    auto key = [](const trace_position_t& p) { return std::make_pair(p.trace, p.step); };
+    std::sort(pairs.begin(), pairs.end(), [&key](const auto& a, const auto& b) {
+        return std::make_pair(key(a.first), key(a.second)) < std::make_pair(key(b.first), key(b.second));
+    });
+    for (const auto& [sub, super] : pairs)
+        std::cout << sub.trace + 1 << ':' << sub.step << " <= " << super.trace + 1 << ':' << super.step << '\n';
+    std::cout << "States: " << index.state_count() << ", distinct: " << index.distinct_count()
+              << ", subsumptions: " << pairs.size() << endl;
+    return EXIT_SUCCESS;
+}
+
+/** Prints a range of steps from a block archive, decompressing only the blocks containing them. */
+static int view_main(int argc, char* args[])
+{
+    auto from = uint64_t{0};
+    auto to = std::numeric_limits<uint64_t>::max();
+    auto files = std::vector<std::string>{};
+    for (int i = 2; i < argc; ++i) {
+        const auto arg = std::string{args[i]};
+        if (arg == "--from" && i + 1 < argc) {
+            from = parse_count(arg, args[++i], false);
+        } else if (arg == "--to" && i + 1 < argc) {
+            to = parse_count(arg, args[++i], false);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << endl;
+            print_usage(args[0]);
+            return EXIT_FAILURE;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 1) {
+        print_usage(args[0]);
+        return EXIT_FAILURE;
+    }
+    const auto archive = block_reader_t{files[0]};
+    archive.print(from, to, std::cout);
+    return EXIT_SUCCESS;
+}
+
+/** Prints the step records published into the shared-memory ring by --shm as they arrive (a reference consumer),
+ * waiting up to 10 seconds for the ring to be created. */
+static int follow_main(int argc, char* args[])
+{
+    if (argc != 3) {
+        print_usage(args[0]);
+        return EXIT_FAILURE;
+    }
+    auto ring = std::unique_ptr<ring_reader_t>{};
+    for (auto attempt = 1; !ring; ++attempt) {
+        try {
+            ring = std::make_unique<ring_reader_t>(args[2]);
+        } catch (std::exception&) {
+            if (attempt == 1000)
+                throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+    }
+    const auto& info = ring->info();
+    auto records = uint64_t{0};
+    for (const auto* record = ring->next(); record != nullptr && std::cout; record = ring->next(), ++records) {
+        const auto* p = record->data();
+        std::cout << "Step " << record->number << ": locations";
+        for (auto i = 0u; i < info.processes; ++i)
+            std::cout << ' ' << *p++;
+        std::cout << "; integers";
+        for (auto i = 0u; i < info.integers; ++i)
+            std::cout << ' ' << *p++;
+        std::cout << "; bounds";
+        for (auto i = 0u; i < record->bounds; ++i, p += 3)
+            std::cout << ' ' << p[0] << ',' << p[1] << ':' << p[2];
+        std::cout << "; edges";
+        for (auto i = 0u; i < record->edges; ++i) {
+            std::cout << ' ' << p[0] << ':' << p[1];
+            const auto selects = p[2];
+            p += 3;
+            for (auto s = 0; s < selects; ++s)
+                std::cout << (s == 0 ? '[' : ',') << *p++;
+            if (selects > 0)
+                std::cout << ']';
+        }
+        std::cout << '\n';
+    }
+    std::cout << "Records: " << records << endl;
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char* args[])
 {
     try {
-        if (argc < 3) {
-            auto name = std::filesystem::path{args[0]}.filename().string();
-            std::cerr << name
-                      << " produces a human readable diagnostic trace by reading:\n"
-                         "\ta UPPAAL model file in the intermediate format (produced by "
-                         "\"UPPAAL_COMPILE_ONLY=1 verifyta model.xml\") and\n"
-                         "\ta trace file in xtr (\"dot\") format.\n";
-            std::cerr << "Synopsis:\n\t" << name << " <if-file> <xtr-trace-file>\n";
+#ifndef _WIN32
+        std::signal(SIGPIPE, SIG_IGN);  // detect closed output as a write error instead of being killed
+#endif
+        if (argc > 1 &&
+            (strcmp(args[1], "corpus") == 0 || strcmp(args[1], "graph") == 0 || strcmp(args[1], "merge") == 0))
+            return batch_main(argc, args);
+        if (argc > 1 && strcmp(args[1], "diff") == 0)
+            return diff_main(argc, args);
+        if (argc > 1 && strcmp(args[1], "subsume") == 0)
+            return subsume_main(argc, args);
+        if (argc > 1 && strcmp(args[1], "view") == 0)
+            return view_main(argc, args);
+        if (argc > 1 && strcmp(args[1], "follow") == 0)
+            return follow_main(argc, args);
+        auto checker = checker_t{};
+        auto run_checker = false;
+        auto options = print_options_t{};
+        auto action = action_t::print;
+        auto slice = std::optional<std::string>{};
+        auto gantt = std::string{};
+        auto blocks = size_t{0};  // steps per compressed block, 0 for the text output
+        auto shm = std::string{};
+        auto shm_size = size_t{1} << 26;
+        auto shm_readers = size_t{0};
+        auto files = std::vector<std::string>{};
+        for (int i = 1; i < argc; ++i) {
+            const auto arg = std::string{args[i]};
+            auto value = [&]() -> std::string {
+                if (i + 1 == argc) {
+                    std::cerr << "Missing value for " << arg << endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                return args[++i];
+            };
+            if (arg == "--checker") {
+                checker.path = value();
+                run_checker = true;
+            } else if (arg == "--checker-options") {
+                checker.options = value();
+            } else if (arg == "--limit") {
+                options.limit = parse_count(arg, value());
+            } else if (arg == "--sample") {
+                options.sample = parse_count(arg, value());
+            } else if (arg == "--tail") {
+                options.tail = parse_count(arg, value());
+            } else if (arg == "--reverse") {
+                options.reverse = true;
+            } else if (arg == "--lasso") {
+                action = action_t::lasso;
+            } else if (arg == "--cut-cycles") {
+                action = action_t::cut_cycles;
+            } else if (arg == "--slice") {
+                slice = value();
+            } else if (arg == "--xtr") {
+                options.xtr = true;
+            } else if (arg == "--clock-intervals") {
+                options.view.intervals = true;
+            } else if (arg == "--hide-internal-clocks") {
+                options.view.internal_clocks = false;
+            } else if (arg == "--gantt") {
+                action = action_t::gantt;
+                gantt = value();
+                if (gantt != "csv" && gantt != "binary")
+                    throw std::invalid_argument{"unknown timeline format: " + gantt};
+            } else if (arg == "--time-window") {
+                options.window = parse_window(arg, value());
+            } else if (arg == "--blocks") {
+                blocks = parse_count(arg, value());
+            } else if (arg == "--checkpoint") {
+                options.checkpoint = value();
+            } else if (arg == "--checkpoint-steps") {
+                options.checkpoint_steps = parse_count(arg, value());
+            } else if (arg == "--resume") {
+                options.resume = true;
+            } else if (arg == "--max-memory") {
+                options.max_memory = parse_memory_size(arg, value());
+            } else if (arg == "--shm") {
+                action = action_t::publish;
+                shm = value();
+            } else if (arg == "--shm-size") {
+                shm_size = parse_memory_size(arg, value());
+            } else if (arg == "--shm-readers") {
+                shm_readers = parse_count(arg, value(), false);
+            } else if (arg.size() > 1 && arg[0] == '-') {
+                std::cerr << "Unknown option: " << arg << endl;
+                print_usage(args[0]);
+                std::exit(EXIT_FAILURE);
+            } else {
+                files.push_back(arg);
+            }
+        }
+        if (files.size() != 2) {
+            print_usage(args[0]);
+            std::exit(EXIT_FAILURE);
+        }
+        if ((slice || options.xtr || options.window) &&
+            (action != action_t::print || options.reverse || options.tail != std::numeric_limits<size_t>::max())) {
+            std::cerr << "--slice, --xtr and --time-window apply only to printing the trace forwards" << endl;
             std::exit(EXIT_FAILURE);
         }
+        if (blocks > 0 && (action != action_t::print || options.reverse || options.xtr || options.window || slice ||
+                           options.sample != 1 || options.tail != std::numeric_limits<size_t>::max())) {
+            std::cerr << "--blocks applies only to printing all the steps forwards" << endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if ((!options.checkpoint.empty() || options.resume) &&
+            (action != action_t::print || options.reverse || options.window || blocks > 0 || run_checker ||
+             options.tail != std::numeric_limits<size_t>::max() || files[1] == "-")) {
+            std::cerr << "--checkpoint and --resume apply only to printing a trace file forwards" << endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if (action == action_t::publish && (slice || options.xtr || options.window || blocks > 0 || options.reverse ||
+                                            options.tail != std::numeric_limits<size_t>::max())) {
+            std::cerr << "--shm publishes the trace forwards, optionally limited or sampled" << endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if (options.resume && options.checkpoint.empty()) {
+            std::cerr << "--resume requires --checkpoint" << endl;
+            std::exit(EXIT_FAILURE);
+        }
+
         auto model = model_t{};
-        // Load model in intermediate format.
-        if (strcmp(args[1], "-") == 0)
-            model.read(std::cin);
-        else {
-            auto file = std::ifstream{args[1]};
-            if (file.fail()) {
-                perror(args[1]);
+        auto trace = std::unique_ptr<std::istream>{};
+        auto process = std::unique_ptr<process_stream_t>{};
+        if (run_checker) {
+            // Compile the model and stream the trace directly from the checker.
+            auto compiled = checker.compile(files[0]);
+            model.read(*compiled);
+            if (auto status = compiled->wait(); status != 0)
+                throw std::runtime_error{"checker failed to compile " + files[0] + " (exit status " +
+                                         std::to_string(status) + ")"};
+            process = checker.verify(files[0], files[1]);
+            if (process->peek() == std::char_traits<char>::eof()) {
+                std::cerr << "The checker produced no diagnostic trace" << endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            if (files[0] == "-" && files[1] == "-") {
+                std::cerr << "Only one of the model and the trace can be read from the standard input" << endl;
+                std::exit(EXIT_FAILURE);
+            }
+            // Load model in intermediate format.
+            load_model(files[0], model);
+            if (action == action_t::print && (options.reverse || options.tail != std::numeric_limits<size_t>::max()) &&
+                files[1] != "-" && std::filesystem::is_regular_file(files[1])) {
+                // Regular uncompressed files are mapped and scanned from the end.
+                auto mapped = mapped_file_t{files[1]};
+                if (detect_compression(mapped.begin(), mapped.size()) == compression_t::none &&
+                    print_tail(model, mapped, std::cout, options))
+                    return EXIT_SUCCESS;
+            }
+            trace = open_input(files[1]);
+            if (!trace) {
+                perror(files[1].c_str());
                 std::exit(EXIT_FAILURE);
             }
-            model.read(file);
         }
+        auto& input = process ? *process : *trace;
+        if (slice) {
+            options.slice.emplace(model, *slice);
+            options.view.processes = options.slice->processes;
+            options.view.integers = options.slice->integers;
+        }
+        if (!options.checkpoint.empty())
+            prepare_checkpoint(model, files[1], *trace, options, slice.value_or(""));
 
-        // Load trace.
-        auto file = std::ifstream{args[2]};
-        if (file.fail()) {
-            perror(args[2]);
-            std::exit(EXIT_FAILURE);
+        auto complete = true;
+        switch (action) {
+        case action_t::print:
+            if (blocks > 0) {
+                auto writer = block_writer_t{std::cout, blocks, hardware_jobs()};
+                complete = write_blocks(model, input, writer, options);
+            } else if (options.reverse || options.tail != std::numeric_limits<size_t>::max()) {
+                print_tail(model, input, std::cout, options);
+            } else if (options.window) {
+                complete = print_time_window(model, input, std::cout, options);
+            } else {  // Stream the trace: print each step as soon as it is read.
+                options.gather = true;
+                complete = print_trace(model, input, std::cout, options);
+                if (complete && !options.checkpoint.empty())
+                    std::filesystem::remove(options.checkpoint);  // a rerun starts from the beginning
+            }
+            break;
+        case action_t::lasso:
+            if (auto lasso = find_lasso(model, input); lasso) {
+                if (lasso->loop_start == 0)
+                    std::cout << "Stem: none, the loop starts in the initial state\n";
+                else
+                    std::cout << "Stem: steps 1-" << lasso->loop_start << '\n';
+                std::cout << "Loop: steps " << lasso->loop_start + 1 << '-' << lasso->loop_end
+                          << ", returning to the state after step " << lasso->loop_start << endl;
+                complete = false;
+            } else {
+                std::cout << "No repeated state" << endl;
+            }
+            break;
+        case action_t::gantt:
+            // Residences are written as soon as the processes leave their locations.
+            if (gantt == "csv") {
+                write_residence_header(std::cout);
+                read_residences(model, input, [&model](const residence_t& r) { write_residence_csv(model, r, std::cout); });
+            } else {
+                write_timeline_header(model, std::cout);
+                read_residences(model, input, [](const residence_t& r) { write_residence_binary(r, std::cout); });
+            }
+            std::cout.flush();
+            break;
+        case action_t::cut_cycles: {
+            const auto acyclic = read_without_cycles(model, input, options.max_memory);
+            if (options.reverse)
+                print_reverse(model, acyclic, std::cout, options);
+            else
+                print_forward(model, acyclic, std::cout, options);
+            break;
         }
-        auto trace = trace_t{};
-        trace.read(model, file);
-        trace.print(model, std::cout);
+        case action_t::publish: {
+            auto ring = ring_writer_t{model, shm, shm_size};
+            ring.wait_readers(shm_readers);
+            complete = publish_trace(model, input, ring, options);
+            break;
+        }
+        }
+        // The checker is terminated by the closed FIFO if the trace was not read completely.
+        if (process)
+            if (auto status = process->wait(); complete && status != 0)
+                throw std::runtime_error{"checker failed with exit status " + std::to_string(status)};
     } catch (std::exception& e) {
         std::cerr << "Caught exception: " << e.what() << endl;
         std::exit(EXIT_FAILURE);
@@ -21,8 +21,14 @@
    USA
 */
 
+#include "scan.hpp"
+#include "spill.hpp"
+#include "store.hpp"
+
+#include <functional>
 #include <limits>
 #include <map>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
@@ -86,6 +92,8 @@ struct edge_t
     int guard{-1};    ///< guard expression index in model_t::layout
     int sync{-1};     ///< synchronization expression index in model_t::layout
     int update{-1};   ///< update expression index in model_t::layout
+    std::vector<int> reads{};   ///< integers read by the guard, synchronization and update (model_t::integers index)
+    std::vector<int> writes{};  ///< integers written by the update (model_t::integers index)
 };
 
 /** The UPPAAL model as in the intermediate format. */
@@ -99,7 +107,9 @@ struct model_t
 
     std::vector<std::string> integers;  ///< integer variable names
     std::vector<std::string> clocks;    ///< clock variable names
-    std::istream& read(std::istream&);  ///< parses the model from input stream
+    std::vector<int> variables;         ///< integer index in integers of each layout cell, -1 if not an integer
+    /// Parses the model from input stream and computes the variables read and written by each edge
+    std::istream& read(std::istream&);
     /** clears all members */
     void clear()
     {
@@ -108,6 +118,9 @@ struct model_t
         processes.clear();
         edges.clear();
         expressions.clear();
+        integers.clear();
+        clocks.clear();
+        variables.clear();
     }
 };
 
@@ -115,9 +128,10 @@ struct model_t
  * bit indicating whether the bound is strict. */
 struct bound_t
 {
-    int value : 31;   ///< The value of the bound
-    bool strict : 1;  ///< True if the bound is strict
+    int32_t value : 31;   ///< The value of the bound
+    uint32_t strict : 1;  ///< True if the bound is strict
 };
+static_assert(sizeof(bound_t) == 4, "bounds are compared and hashed as raw 32-bit words");
 
 /** The bound (infinity, <). */
 static constexpr bound_t infinity = {std::numeric_limits<int32_t>::max() >> 1, true};
@@ -125,6 +139,15 @@ static constexpr bound_t infinity = {std::numeric_limits<int32_t>::max() >> 1, t
 /** The bound (0, <=). */
 static constexpr bound_t zero = {0, false};
 
+/** Selects what State::print shows. */
+struct state_view_t
+{
+    std::vector<bool> processes;  ///< show the locations of these processes (all if empty)
+    std::vector<bool> integers;   ///< show the values of these integers (all if empty)
+    bool intervals{false};        ///< show the lower and upper bound of each clock instead of the difference bounds
+    bool internal_clocks{true};   ///< show the clocks whose names start with '#' (e.g. #time)
+};
+
 /** A symbolic state: process location vector, integer values and a DBM */
 struct State
 {
@@ -136,8 +159,15 @@ struct State
     void set_bound(size_t clock_count, int i, int j, bound_t bound);
     /// Gets the bound over (#i - #j) clock difference
     const bound_t& get_bound(size_t clock_count, int i, int j) const;
-    std::ostream& print(const model_t&, std::ostream&) const;
+    /// Computes the tightest lower (0 - x) and upper (x - 0) bound of each clock x implied by the DBM
+    void clock_bounds(size_t clock_count, std::vector<bound_t>& lower, std::vector<bound_t>& upper) const;
+    /// Prints the locations, the integers and the clock constraints selected by the view
+    std::ostream& print(const model_t&, std::ostream&, const state_view_t& view = {}) const;
     std::istream& read(const model_t&, std::istream&);
+    /// Parses the state from whole lines in the strict xtr layout, returns false upon any deviation
+    bool read(const model_t&, line_index_t& lines);
+    /// Writes the state in the xtr format
+    std::ostream& write(const model_t&, std::ostream&) const;
 };
 
 /** A transition edge (syntactic edge with values) */
@@ -155,21 +185,202 @@ struct Transition
     std::vector<Edge> edges{};
     std::ostream& print(const model_t&, std::ostream&) const;
     std::istream& read(const model_t&, std::istream&);
+    /// Parses the transition line in the current format (edges terminated by ';'), returns false upon any deviation
+    bool read(const model_t&, line_index_t& lines);
+    /// Writes the transition in the (current) xtr format
+    std::ostream& write(const model_t&, std::ostream&) const;
 };
 
 struct Successor
 {
     Transition transition;
     State state;
+    Successor() = default;
     Successor(Transition transition, State state): transition{std::move(transition)}, state{std::move(state)} {}
+    /// Prints the transition followed by the successor state
+    std::ostream& print(const model_t&, std::ostream&, const state_view_t& view = {}) const;
+};
+
+/** Projection of a trace onto a subset of processes and integer variables: steps whose transitions
+ * neither involve the selected processes nor write the selected variables are dropped,
+ * and states show only the selected locations and variables. */
+struct trace_slice_t
+{
+    std::vector<bool> processes;  ///< selected processes indexed as model_t::processes, empty if none selected
+    std::vector<bool> integers;   ///< selected variables indexed as model_t::integers, empty if none selected
+
+    /// Selects the processes and variables by their comma separated names,
+    /// throws std::invalid_argument upon an unknown name
+    trace_slice_t(const model_t&, const std::string& names);
+    /// True if an edge of the transition belongs to a selected process or writes a selected variable
+    bool involves(const model_t&, const Transition&) const;
+};
+
+class window_buffer_t;
+
+/** Reads the trace one step at a time, so that arbitrary long traces can be
+ * processed from files, pipes and standard input without storing them.
+ * Steps lying within the buffered input of the stream are parsed in place from its line index,
+ * other steps (e.g. crossing the buffer end or in an old format) are parsed from the stream. */
+class trace_reader_t
+{
+    const model_t& model;
+    std::istream& is;
+    window_buffer_t* buffer;  ///< the stream buffer if it supports parsing in place
+    line_index_t lines;
+
+    /// Parses in place, consuming the input only if the parse succeeds
+    template <typename Parse>
+    bool read_lines(Parse&& parse);
+
+public:
+    trace_reader_t(const model_t& model, std::istream& is);
+    /// Reads the initial state, must be called once before the first step
+    std::istream& read_initial(State& state);
+    /// Reads the next step, returns false when the trace-terminating dot is reached
+    bool next(Successor& step);
+};
+
+/** Identifies the components of a state stored in state_store_t. */
+struct state_id_t
+{
+    uint32_t locations{0};
+    uint32_t integers{0};
+    uint32_t dbm{0};
+    bool operator==(const state_id_t& o) const
+    {
+        return locations == o.locations && integers == o.integers && dbm == o.dbm;
+    }
+    bool operator!=(const state_id_t& o) const { return !(*this == o); }
+};
+
+template <>
+struct std::hash<state_id_t>
+{
+    size_t operator()(const state_id_t& id) const noexcept
+    {
+        return (id.locations * 0x9E3779B97F4A7C15ull) ^ (id.integers * 0xC2B2AE3D27D4EB4Full) ^ id.dbm;
+    }
+};
+
+/** Identifies a stored step: the transition and the successor state. */
+struct step_id_t
+{
+    uint32_t transition{0};
+    state_id_t state{};
+    bool operator==(const step_id_t& o) const { return transition == o.transition && state == o.state; }
+    bool operator!=(const step_id_t& o) const { return !(*this == o); }
+};
+
+/** Hash-consing store of states and transitions: equal location vectors, integer vectors,
+ * DBMs and transitions are stored once, so repetitive traces take memory only for their distinct parts.
+ * The pool type decides thread-safety: array_pool_t is for a single thread, sharded_pool_t for many. */
+template <template <typename> class Pool>
+class basic_state_store_t
+{
+    Pool<int> locations;
+    Pool<int> integers;
+    Pool<bound_t> dbms;
+    Pool<int> transitions;  ///< edges encoded as process, edge, select count, select values
+
+public:
+    state_id_t intern(const State& state)
+    {
+        return {locations.intern(state.locations), integers.intern(state.integers), dbms.intern(state.dbm)};
+    }
+    uint32_t intern(const Transition& transition)
+    {
+        thread_local auto buffer = std::vector<int>{};
+        buffer.clear();
+        for (const auto& e : transition.edges) {
+            buffer.push_back(e.process);
+            buffer.push_back(e.edge);
+            buffer.push_back(e.select.size());
+            buffer.insert(buffer.end(), e.select.begin(), e.select.end());
+        }
+        return transitions.intern(buffer);
+    }
+    step_id_t intern(const Successor& step) { return {intern(step.transition), intern(step.state)}; }
+    void load(state_id_t id, State& state) const
+    {
+        locations.load(id.locations, state.locations);
+        integers.load(id.integers, state.integers);
+        dbms.load(id.dbm, state.dbm);
+    }
+    void load(uint32_t id, Transition& transition) const
+    {
+        thread_local auto buffer = std::vector<int>{};
+        transitions.load(id, buffer);
+        transition.edges.clear();
+        for (auto p = buffer.begin(); p != buffer.end(); p += 3 + p[2])
+            transition.edges.push_back(Edge{p[0], p[1], std::vector<int>(p + 3, p + 3 + p[2])});
+    }
+    void load(step_id_t id, Successor& step) const
+    {
+        load(id.transition, step.transition);
+        load(id.state, step.state);
+    }
+    /// Hash of the state contents, the same for equal states in stores filled in any order
+    uint64_t hash(state_id_t id) const
+    {
+        constexpr auto prime = 0x9E3779B97F4A7C15ull;
+        return ((locations.hash(id.locations) * prime) ^ integers.hash(id.integers)) * prime ^ dbms.hash(id.dbm);
+    }
+    /// Hash of the transition contents
+    uint64_t hash(uint32_t id) const { return transitions.hash(id); }
+    size_t location_count() const { return locations.count(); }      ///< distinct location vectors
+    size_t integer_count() const { return integers.count(); }        ///< distinct integer vectors
+    size_t dbm_count() const { return dbms.count(); }                ///< distinct DBMs
+    size_t transition_count() const { return transitions.count(); }  ///< distinct transitions
+    /// Number of bytes allocated
+    size_t memory() const
+    {
+        return locations.memory() + integers.memory() + dbms.memory() + transitions.memory();
+    }
+    void clear()
+    {
+        locations.clear();
+        integers.clear();
+        dbms.clear();
+        transitions.clear();
+    }
 };
 
+template <typename T>
+using shared_pool_t = sharded_pool_t<T>;
+
+using state_store_t = basic_state_store_t<array_pool_t>;
+using shared_state_store_t = basic_state_store_t<shared_pool_t>;
+
+/** The steps of a stored trace, spilled to disk beyond the memory budget if any. */
+using step_list_t = spill_list_t<step_id_t>;
+
+/** A trace stored with its states and transitions hash-consed. */
 struct trace_t
 {
-    State initial{};
-    std::vector<Successor> steps;
+    state_store_t store;
+    state_id_t initial{};
+    step_list_t steps;
     std::istream& read(const model_t&, std::istream&);
-    std::ostream& print(const model_t&, std::ostream&) const;
+    std::ostream& print(const model_t&, std::ostream&, const state_view_t& view = {}) const;
 };
 
+/** A lasso: the state reached after step loop_end is the same as the state after step loop_start
+ * (step 0 denotes the initial state), i.e. steps 1..loop_start form the stem
+ * and steps loop_start+1..loop_end form the loop. */
+struct lasso_t
+{
+    size_t loop_start{0};
+    size_t loop_end{0};
+};
+
+/** Finds the earliest repeated symbolic state (equal locations, integers and DBM) in a single pass,
+ * reading the trace only until the first repetition. */
+std::optional<lasso_t> find_lasso(const model_t&, std::istream&);
+
+/** Reads the trace and cuts out its cycles, so that no state repeats,
+ * except that the last step is always kept and thus may close the loop of a lasso.
+ * The steps beyond max_memory bytes are spilled to disk. */
+trace_t read_without_cycles(const model_t&, std::istream&, size_t max_memory = step_list_t::unlimited);
+
 #endif  // TRACER_TRACER_HPP
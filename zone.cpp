@@ -0,0 +1,182 @@
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+#include "zone.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+int32_t add_bounds(int32_t a, int32_t b)
+{
+    if (a == zone_t::unbounded || b == zone_t::unbounded)
+        return zone_t::unbounded;
+    const auto sum = int64_t{a & ~1} + int64_t{b & ~1};
+    if (sum >= zone_t::unbounded)
+        return zone_t::unbounded;
+    if (sum <= -zone_t::unbounded)
+        return -zone_t::unbounded;
+    return static_cast<int32_t>(sum) | (a & b & 1);
+}
+
+zone_t::zone_t(const State& state, size_t clock_count): dim{clock_count}, bounds(clock_count * clock_count)
+{
+    assert(state.dbm.size() == bounds.size());
+    std::transform(state.dbm.begin(), state.dbm.end(), bounds.begin(), &zone_t::encode);
+    auto* d = bounds.data();
+    for (size_t k = 0; k < dim; ++k) {
+        for (size_t i = 0; i < dim; ++i) {
+            const auto ik = d[i * dim + k];
+            if (ik == unbounded)
+                continue;
+            for (size_t j = 0; j < dim; ++j)
+                d[i * dim + j] = std::min(d[i * dim + j], add_bounds(ik, d[k * dim + j]));
+        }
+    }
+}
+
+bool zone_t::empty() const
+{
+    for (size_t i = 0; i < dim; ++i)
+        if (bounds[i * dim + i] < encode(zero))
+            return true;
+    return false;
+}
+
+bool bounds_subset(const int32_t* a, const int32_t* b, size_t size)
+{
+    // Branch-free blocks get vectorized, the early exit is taken between blocks.
+    constexpr size_t block = 16;
+    auto i = size_t{0};
+    for (; i + block <= size; i += block) {
+        auto greater = 0;
+        for (size_t k = 0; k < block; ++k)
+            greater |= a[i + k] > b[i + k];
+        if (greater)
+            return false;
+    }
+    auto greater = 0;
+    for (; i < size; ++i)
+        greater |= a[i] > b[i];
+    return greater == 0;
+}
+
+bool zone_t::subset_of(const zone_t& other) const
+{
+    assert(dim == other.dim);
+    return empty() || bounds_subset(bounds.data(), other.bounds.data(), bounds.size());
+}
+
+void time_index_t::push_back(const zone_t& zone, size_t clock)
+{
+    if (!lower.empty() && zone.at(0, clock) > lower.back())
+        monotone = false;
+    lower.push_back(zone.at(0, clock));
+    upper.push_back(zone.at(clock, 0));
+}
+
+void time_index_t::build()
+{
+    // A perfect tree with the leaves at [leaves, 2*leaves) and node i covering the children 2i and 2i+1.
+    leaves = 1;
+    while (leaves < size())
+        leaves *= 2;
+    tree.assign(2 * leaves, -zone_t::unbounded);
+    std::copy(upper.begin(), upper.end(), tree.begin() + leaves);
+    for (auto i = leaves; i-- > 1;)
+        tree[i] = std::max(tree[2 * i], tree[2 * i + 1]);
+}
+
+void time_index_t::collect(size_t node, size_t begin, size_t end, size_t last, int32_t from,
+                           std::vector<size_t>& res) const
+{
+    // Descends into the nodes covering [begin, end) unless they are past last or end before the window.
+    if (begin >= last || add_bounds(tree[node], -from * 2 + 1) < 1)
+        return;
+    if (end - begin == 1) {
+        res.push_back(begin);
+        return;
+    }
+    const auto mid = begin + (end - begin) / 2;
+    collect(2 * node, begin, mid, last, from, res);
+    collect(2 * node + 1, mid, end, last, from, res);
+}
+
+std::vector<size_t> time_index_t::find(int32_t from, int32_t to) const
+{
+    auto res = std::vector<size_t>{};
+    if (from > to || lower.empty())
+        return res;
+    // States starting after the window: a suffix if the lower bounds are monotone, otherwise filtered one by one.
+    auto last = size();
+    if (monotone) {
+        auto i = std::partition_point(lower.begin(), lower.end(),
+                                      [to](int32_t l) { return add_bounds(l, to * 2 + 1) >= 1; });
+        last = i - lower.begin();
+    }
+    collect(1, 0, leaves, last, from, res);
+    if (!monotone)
+        res.erase(std::remove_if(res.begin(), res.end(), [&](size_t i) { return !starts_before(i, to); }), res.end());
+    return res;
+}
+
+uint32_t subsumption_index_t::add(const model_t& model, std::istream& is)
+{
+    const auto trace = traces++;
+    auto reader = trace_reader_t{model, is};
+    auto step = Successor{};
+    auto visit = [&](uint32_t n) {
+        ++states;
+        const auto id = store.intern(step.state);
+        auto [it, inserted] = index.try_emplace(id, entries.size());
+        if (inserted) {
+            entries.push_back({{{trace, n}}, zone_t{step.state, model.clocks.size()}});
+            groups[(uint64_t{id.locations} << 32) | id.integers].push_back(it->second);
+        } else if (auto& first = entries[it->second].first; first.back().trace != trace) {
+            first.push_back({trace, n});
+        }
+    };
+    reader.read_initial(step.state);
+    visit(0);
+    for (uint32_t n = 1; reader.next(step); ++n)
+        visit(n);
+    return trace;
+}
+
+void subsumption_index_t::for_each(
+    const std::function<void(const trace_position_t& sub, const trace_position_t& super)>& visit) const
+{
+    for (const auto& entry : entries)
+        for (const auto& a : entry.first)
+            for (const auto& b : entry.first)
+                if (a.trace != b.trace)
+                    visit(a, b);
+    for (const auto& [key, group] : groups) {
+        for (auto sub : group) {
+            const auto& a = entries[sub];
+            for (auto super : group) {
+                if (sub == super || !a.zone.subset_of(entries[super].zone))
+                    continue;
+                for (const auto& pa : a.first)
+                    for (const auto& pb : entries[super].first)
+                        visit(pa, pb);
+            }
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef TRACER_ZONE_HPP
+#define TRACER_ZONE_HPP
+
+/** tracer - Utility for printing UPPAAL XTR trace files.
+   Copyright (C) 2017-2023 Aalborg University.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation; either version 2.1 of
+   the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+   USA
+*/
+
+
+#include "tracer.hpp"
+
+#include <functional>
+#include <istream>
+#include <unordered_map>
+#include <vector>
+
+/** A clock zone in the closed (canonical) form with the bounds encoded as integers ordered like the bounds:
+ * (v,<) is encoded as 2v and (v,<=) as 2v+1, so that bounds compare and add as plain integers
+ * and zone inclusion is an element-wise comparison which the compiler vectorizes. */
+class zone_t
+{
+    size_t dim{0};
+    std::vector<int32_t> bounds;  ///< row-major clock difference bounds
+
+public:
+    static constexpr int32_t unbounded = infinity.value * 2;  ///< encoded infinity (always strict)
+
+    static int32_t encode(bound_t b) { return b.value == infinity.value ? unbounded : b.value * 2 + (b.strict ? 0 : 1); }
+    static bound_t decode(int32_t b) { return {b >> 1, (b & 1) == 0}; }
+
+    zone_t() = default;
+    /// Takes the DBM of the state and closes it (Floyd-Warshall shortest paths)
+    zone_t(const State&, size_t clock_count);
+    size_t dimension() const { return dim; }
+    const int32_t* data() const { return bounds.data(); }
+    /// Encoded bound of (i - j)
+    int32_t at(size_t i, size_t j) const { return bounds[i * dim + j]; }
+    /// True if the zone has no clock valuation (a negative cycle)
+    bool empty() const;
+    /// True if every clock valuation of this zone is in the other zone (this ⊆ other)
+    bool subset_of(const zone_t& other) const;
+};
+
+/** Adds encoded bounds: the sum is non-strict only if both bounds are non-strict. */
+int32_t add_bounds(int32_t a, int32_t b);
+
+/** Index of the time intervals of the states of a trace (bounds on a clock never reset, i.e. #time) for
+ * time window queries. Along a trace the lower time bounds do not decrease, hence the states starting before the end
+ * of the window are a prefix found by binary search, and a max tree over the upper bounds reports those ending after
+ * the start of the window in O(log n) per reported state. */
+class time_index_t
+{
+    std::vector<int32_t> lower;  ///< encoded bound on (0 - time) per state
+    std::vector<int32_t> upper;  ///< encoded bound on (time - 0) per state
+    std::vector<int32_t> tree;   ///< maximum upper bounds over ranges of states (implicit binary tree)
+    size_t leaves{1};            ///< number of tree leaves (a power of two)
+    bool monotone{true};         ///< the lower bounds do not decrease
+
+    void collect(size_t node, size_t begin, size_t end, size_t last, int32_t from, std::vector<size_t>& res) const;
+
+public:
+    /// Adds the time interval of the next state
+    void push_back(const zone_t& zone, size_t clock);
+    size_t size() const { return lower.size(); }
+    /// True if the time interval of the state ends after the time (time <= value is satisfiable)
+    bool starts_before(size_t state, int32_t value) const { return add_bounds(lower[state], value * 2 + 1) >= 1; }
+    /// Builds the tree, must be called after adding the states and before the queries
+    void build();
+    /// Returns the indices of the states whose time interval intersects [from, to] in increasing order
+    std::vector<size_t> find(int32_t from, int32_t to) const;
+};
+
+/** Tests inclusion of closed zones over their encoded bounds: a ⊆ b iff a[i] <= b[i] for all i. */
+bool bounds_subset(const int32_t* a, const int32_t* b, size_t size);
+
+/** Position of a symbolic state in a trace: the state after the given number of steps (0 is the initial state). */
+struct trace_position_t
+{
+    uint32_t trace{0};
+    uint32_t step{0};
+};
+
+/** Finds subsumed symbolic states: a state is subsumed by another one with the same locations and integers
+ * whose zone includes its zone. States are hash-consed and only compared within groups
+ * of equal locations and integers, equal states are compared only once (at their first occurrence). */
+class subsumption_index_t
+{
+    struct entry_t
+    {
+        std::vector<trace_position_t> first;  ///< first occurrence in each trace containing the state
+        zone_t zone;
+    };
+    state_store_t store;
+    std::unordered_map<state_id_t, size_t> index;                ///< state -> entry
+    std::vector<entry_t> entries;
+    std::unordered_map<uint64_t, std::vector<size_t>> groups;  ///< locations and integers -> entries
+    uint32_t traces{0};
+    size_t states{0};
+
+public:
+    /// Reads the trace and adds its states, returns the trace number (from 0)
+    uint32_t add(const model_t&, std::istream&);
+    /// Number of states added (including repetitions)
+    size_t state_count() const { return states; }
+    /// Number of distinct states
+    size_t distinct_count() const { return entries.size(); }
+    /// Calls visit(sub, super) for every pair of states where sub ⊆ super,
+    /// equal states are visited only for their first occurrences in different traces
+    void for_each(const std::function<void(const trace_position_t& sub, const trace_position_t& super)>& visit) const;
+};
+
+#endif  // TRACER_ZONE_HPP